@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "election.hpp"
+#include "permutation.hpp"
+#include "simulation.hpp"
+#include "topology.hpp"
+
+using namespace std;
+
+// What a ring of a given size costs, over many elections instead of a single run:
+// each trial simulates an election on its own ring, drawn from the seed and the trial number only,
+// so the results are the same whatever the number of workers they are spread over.
+namespace analysis
+{
+    struct Trial
+    {
+        double electionTime = 0; // virtual seconds until the last node decided
+        uint64_t messages = 0;
+    };
+
+    struct Summary
+    {
+        double mean = 0;
+        double p50 = 0;
+        double p99 = 0;
+        double max = 0;
+    };
+
+    // exact, the percentiles are nearest ranks
+    Summary summarize(vector<double> values)
+    {
+        Summary ret;
+        if (values.empty())
+        {
+            return ret;
+        }
+        std::sort(values.begin(), values.end());
+        auto rank = [&values] (double fraction)
+        {
+            auto const index = static_cast<size_t>(std::ceil(fraction * values.size()));
+            return values[std::clamp<size_t>(index, 1, values.size()) - 1];
+        };
+        for (auto value: values)
+        {
+            ret.mean += value / values.size();
+        }
+        ret.p50 = rank(0.5);
+        ret.p99 = rank(0.99);
+        ret.max = values.back();
+        return ret;
+    }
+
+    // the probability that at least two of n IDs drawn uniformly among 2^bits are equal,
+    // the birthday problem: 1 - M! / ((M - n)! M^n) with M = 2^bits, in constant time whatever n
+    double collisionProbability(double n, int bits)
+    {
+        auto const m = std::ldexp(1.0, bits);
+        if (n < 2)
+        {
+            return 0;
+        }
+        if (n > m)
+        {
+            return 1;
+        }
+        double logNoCollision;
+        if (n * n / m < 1e-3)
+        {
+            // the sum of log(1 - i/M) over i < n, to its first two terms, exact to the precision of a double there
+            logNoCollision = -n * (n - 1) / (2 * m) - n * (n - 1) * (2 * n - 1) / (12 * m * m);
+        }
+        else if (m - n < 16)
+        {
+            logNoCollision = std::lgamma(m + 1) - std::lgamma(m - n + 1) - n * std::log(m);
+        }
+        else
+        {
+            // the ratio of factorials with Stirling's formula, log1p keeps it precise for large M
+            logNoCollision = -(m - n + 0.5) * std::log1p(-n / m) - n + 1 / (12 * m) - 1 / (12 * (m - n));
+        }
+        return -std::expm1(logNoCollision);
+    }
+
+    // the fewest IDs drawn among 2^bits whose probability of a collision reaches the given one, at most 2^bits + 1 where it is certain
+    // searched instead of sqrt(2 M ln(1 / (1 - p))), which only holds when the ID space is large
+    double nodesForCollision(double probability, int bits)
+    {
+        if (probability <= 0)
+        {
+            return 1;
+        }
+        auto const most = std::ldexp(1.0, bits) + 1;
+        auto reaches = [probability, bits] (double n) { return collisionProbability(n, bits) >= probability; };
+        // doubles up to a count that reaches it, then bisects between it and the last one that did not, a single node never does
+        double low = 1;
+        double high = 2;
+        while (high < most && reaches(high) == false)
+        {
+            low = high;
+            high = std::min(most, high * 2);
+        }
+        while (high - low > 1)
+        {
+            auto const middle = std::floor(low + (high - low) / 2);
+            if (middle == low || middle == high)
+            {
+                // past 2^53 the doubles are further apart than a node
+                break;
+            }
+            (reaches(middle) ? high : low) = middle;
+        }
+        return high;
+    }
+
+    // Runs the trials on the given number of threads. Each ring, or graph when one is given, has distinct IDs in a random order,
+    // from a permutation keyed by the trial, and delays drawn with replacement from the given ones.
+    // With sub-rings of the given size, each trial is a run of the hierarchical mode, on the thread of the trial.
+    // throws when a trial does not end with every node agreeing on the largest ID
+    vector<Trial> run(size_t trials, vector<float> const& delays, election::Algorithm algorithm,
+        election::Discovery discovery, int bits, uint64_t seed, size_t workers, topology::Graph const* graph = nullptr,
+        optional<size_t> hierarchy = nullopt)
+    {
+        auto const count = delays.size();
+        if (count == 0 || count - 1 > permutation::Feistel{bits, 0}.getMax())
+        {
+            throw std::runtime_error("Not enough distinct " + std::to_string(bits) + "-bit IDs for " + std::to_string(count) + " nodes");
+        }
+        vector<Trial> ret(trials);
+        atomic<size_t> next{0};
+        atomic<bool> failed{false};
+        auto work = [&] ()
+        {
+            vector<election::ID> ids(count);
+            vector<float> drawn(count);
+            while (failed.load(memory_order_relaxed) == false)
+            {
+                auto const trial = next.fetch_add(1, memory_order_relaxed);
+                if (trial >= trials)
+                {
+                    return;
+                }
+                auto const trialSeed = permutation::mix(seed ^ permutation::mix(trial));
+                auto const permute = permutation::Feistel{bits, trialSeed};
+                mt19937_64 random{trialSeed};
+                uniform_int_distribution<size_t> pick{0, count - 1};
+                for (size_t i=0; i<count; ++i)
+                {
+                    ids[i] = permute(i);
+                    drawn[i] = delays[pick(random)];
+                }
+                auto const result =
+                    graph ? simulation::runGraph(*graph, ids, drawn) :
+                    hierarchy ? simulation::runHierarchy(ids, drawn, algorithm, discovery, *hierarchy).result :
+                    simulation::run(ids, drawn, algorithm, discovery);
+                auto const leader = *std::max_element(ids.begin(), ids.end());
+                if (std::any_of(result.leaders.begin(), result.leaders.end(), [leader] (auto const& elected) {
+                    return elected != leader; }))
+                {
+                    failed.store(true, memory_order_relaxed);
+                    return;
+                }
+                ret[trial] = { result.electionTime, result.messages };
+            }
+        };
+        vector<thread> threads;
+        for (size_t i=1; i<std::max<size_t>(1, std::min(workers, trials)); ++i)
+        {
+            threads.emplace_back(work);
+        }
+        work();
+        for (auto& thread: threads)
+        {
+            thread.join();
+        }
+        if (failed)
+        {
+            throw std::runtime_error("A trial did not agree on the largest ID");
+        }
+        return ret;
+    }
+}
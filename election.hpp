@@ -0,0 +1,689 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <variant>
+
+#include "json.hpp"
+
+using namespace std;
+using namespace json;
+
+namespace election
+{
+    using ID = decltype(Message::id);
+
+    enum struct State
+    {
+        Offline,
+        Participating,
+        Decided,
+        Leader,
+    };
+
+    auto describe(State state)
+    {
+        switch (state)
+        {
+        case State::Offline: return "Offline";
+        case State::Participating: return "Participating";
+        case State::Decided: return "Decided";
+        case State::Leader: return "Leader";
+        }
+        return "Unknown";
+    }
+
+    enum struct Algorithm
+    {
+        ChangRoberts,       // unidirectional ring, O(N^2) messages in the worst case
+        HirschbergSinclair, // bidirectional ring, O(N log N) messages
+        Echo,               // any connected graph, in about three times its diameter, see EchoWave
+    };
+
+    // whether the algorithm sends counter-clockwise too on a ring
+    auto bidirectional(Algorithm algorithm) { return algorithm != Algorithm::ChangRoberts; }
+
+    // the neighbor a message is sent to, or received from
+    // node i talks clockwise to node i+1 and counter-clockwise to node i-1
+    enum struct Side
+    {
+        Clockwise,
+        CounterClockwise,
+    };
+
+    auto opposite(Side side)
+    {
+        return side == Side::Clockwise ? Side::CounterClockwise : Side::Clockwise;
+    }
+
+    // how the nodes learn that the whole ring is up before electing
+    enum struct Discovery
+    {
+        Flood, // every node sends Greetings all the way around, N^2 messages
+        Sweep, // one node counts the ring with a Greetings, then announces its size with another, 2N messages
+    };
+
+    // What all the algorithms share, independent of threads and sockets:
+    // whoever drives a machine delivers the received messages with the side they came from,
+    // and carries what is handed to send() to the neighbor on the given side.
+    // Nodes first discover each other with Greetings sent clockwise, then elect, then announce the leader clockwise.
+    class RingMember
+    {
+    public:
+        explicit RingMember(ID id) : id(id) {}
+
+        auto getState() const { return state; }
+        auto getLeader() const { return leader; }
+        auto getFinished() const { return finished; }
+        // the number of nodes known to be up, myself included, 0 when the ring was known to be up from the start
+        auto getRingSize() const { return ringSize; }
+
+        // with a sweep, only the initiator sends, the others wait for its Greetings to come by
+        template <typename Send>
+        void start(Send&& send, Discovery discovery = Discovery::Flood, bool initiator = true)
+        {
+            this->discovery = discovery;
+            ringSize = 1;
+            if (discovery == Discovery::Sweep && initiator == false)
+            {
+                return;
+            }
+            // spec says "then it will send a message indicating its unique ID"
+            // which is ambiguous as regards the message type
+            // we will thus call this message Greetings
+            // the hops count the nodes the sweep went through, and the phase is 1 when it announces the ring size
+            send(Message{ id, Message::Type::Greetings, "", 0, 1 }, Side::Clockwise);
+        }
+
+        // instead of start(), when whoever drives the ring knows that every node is up:
+        // the election can begin without the Greetings round, and without knowing the ring size
+        void ready()
+        {
+            allReady = true;
+        }
+
+    protected:
+        ID id;
+        State state = State::Offline;
+        Discovery discovery = Discovery::Flood;
+        size_t ringSize = 0;
+        optional<ID> leader;
+        bool allReady = false;
+        bool finished = false;
+
+        // returns false when the message is not a Greetings
+        template <typename Send>
+        bool greet(Message msg, Send&& send, string& actionDescription)
+        {
+            if (msg.type != Message::Type::Greetings)
+            {
+                return false;
+            }
+            if (discovery == Discovery::Flood)
+            {
+                if (msg.id != id)
+                {
+                    ++ringSize;
+                    actionDescription += "forwarding";
+                    send(msg, Side::Clockwise);
+                }
+                else
+                {
+                    allReady = true;
+                    actionDescription += "noop";
+                }
+            }
+            else if (msg.id != id)
+            {
+                if (msg.phase == 1)
+                {
+                    ringSize = msg.hops;
+                    allReady = true;
+                }
+                else
+                {
+                    ++msg.hops;
+                }
+                actionDescription += "forwarding";
+                send(msg, Side::Clockwise);
+            }
+            else if (msg.phase == 0)
+            {
+                // the sweep went around so every node is up, the others learn it from the announce
+                ringSize = msg.hops;
+                allReady = true;
+                actionDescription += "announcing a ring of " + std::to_string(ringSize);
+                send(Message{ id, Message::Type::Greetings, "", 1, msg.hops }, Side::Clockwise);
+            }
+            else
+            {
+                actionDescription += "noop";
+            }
+            return true;
+        }
+
+        template <typename Send>
+        void elected(Send&& send, string& actionDescription)
+        {
+            leader = id;
+            state = State::Leader;
+            actionDescription += "sending i am the leader";
+            send(Message{ id, Message::Type::ElectedLeader, "" }, Side::Clockwise);
+        }
+
+        // returns false when the message is not an ElectedLeader
+        template <typename Send>
+        bool announce(Message const& msg, Send&& send, string& actionDescription)
+        {
+            if (msg.type != Message::Type::ElectedLeader)
+            {
+                return false;
+            }
+            if (msg.id != id)
+            {
+                // marks myself as a decided, record the elected UID, and forward
+                state = State::Decided;
+                leader = msg.id;
+                actionDescription += "forwarding";
+                send(msg, Side::Clockwise);
+            }
+            else
+            {
+                actionDescription += "noop";
+                // election is over
+            }
+            assert(leader);
+            finished = true;
+            return true;
+        }
+    };
+
+    // Chang-Roberts: election messages only go clockwise
+    class ChangRoberts : public RingMember
+    {
+    public:
+        using RingMember::RingMember;
+
+        // returns a description of the action taken, for the log
+        template <typename Send>
+        string receive(Message msg, Side, Send&& send)
+        {
+            auto actionDescription = string{};
+            if (greet(msg, send, actionDescription) || announce(msg, send, actionDescription))
+            {
+                return actionDescription;
+            }
+            if (msg.type == Message::Type::ElectionStart)
+            {
+                if (msg.id > id)
+                {
+                    // unconditionally forward
+                    state = State::Participating;
+                    actionDescription += "forwarding";
+                    send(msg, Side::Clockwise);
+                }
+                else if (msg.id < id)
+                {
+                    if (state != State::Participating)
+                    {
+                        // replace the UID in the message with my own UID and send
+                        state = State::Participating;
+                        msg.id = id;
+                        actionDescription += "forwarding with my id";
+                        send(msg, Side::Clockwise);
+                    }
+                    else
+                    {
+                        // discard the election message
+                        actionDescription += "noop";
+                    }
+                }
+                else
+                {
+                    // i am the leader
+                    assert(msg.id == id);
+                    elected(send, actionDescription);
+                }
+            }
+            return actionDescription;
+        }
+
+        // returns true when this call started an election
+        template <typename Send>
+        bool startIfReady(Send&& send)
+        {
+            if (state != State::Offline
+                || allReady == false // waiting for my peers to be ready
+                )
+            {
+                return false;
+            }
+            // we notice the lack of a leader
+            state = State::Participating;
+            send(Message{ id, Message::Type::ElectionStart, "something" }, Side::Clockwise);
+            return true;
+        }
+    };
+
+    // Hirschberg-Sinclair: in phase k a candidate probes 2^k hops on both sides,
+    // and moves to the next phase when both probes come back as replies.
+    // A probe is turned back as soon as it meets a larger id, so only the largest id goes all the way around,
+    // and there are at most log N phases of O(N) messages each.
+    class HirschbergSinclair : public RingMember
+    {
+    public:
+        using RingMember::RingMember;
+
+        template <typename Send>
+        string receive(Message msg, Side from, Send&& send)
+        {
+            auto actionDescription = string{};
+            if (greet(msg, send, actionDescription) || announce(msg, send, actionDescription))
+            {
+                return actionDescription;
+            }
+            if (msg.type == Message::Type::Probe)
+            {
+                if (msg.id == id)
+                {
+                    // my probe went all the way around, the probe on the other side may still come back
+                    if (state != State::Leader)
+                    {
+                        elected(send, actionDescription);
+                    }
+                    else
+                    {
+                        actionDescription += "noop";
+                    }
+                }
+                else if (msg.id > id)
+                {
+                    // a probe of the leader may still pass after its announcement did, the node stays decided
+                    if (finished == false)
+                    {
+                        state = State::Participating;
+                    }
+                    if (msg.hops < (uint32_t{1} << msg.phase))
+                    {
+                        ++msg.hops;
+                        actionDescription += "forwarding";
+                        send(msg, opposite(from));
+                    }
+                    else
+                    {
+                        actionDescription += "replying";
+                        send(Message{ msg.id, Message::Type::Reply, "", msg.phase, 0 }, from);
+                    }
+                }
+                else
+                {
+                    // swallow the smaller probe, and take part if I did not yet
+                    actionDescription += "noop";
+                    if (state == State::Offline)
+                    {
+                        actionDescription += ", probing with my id";
+                        probe(send);
+                    }
+                }
+            }
+            else if (msg.type == Message::Type::Reply)
+            {
+                if (msg.id != id)
+                {
+                    actionDescription += "forwarding";
+                    send(msg, opposite(from));
+                }
+                else if (msg.phase == phase && ++replies == 2)
+                {
+                    ++phase;
+                    actionDescription += "probing phase " + std::to_string(phase);
+                    probe(send);
+                }
+                else
+                {
+                    actionDescription += "waiting for the other reply";
+                }
+            }
+            return actionDescription;
+        }
+
+        template <typename Send>
+        bool startIfReady(Send&& send)
+        {
+            if (state != State::Offline || allReady == false)
+            {
+                return false;
+            }
+            probe(send);
+            return true;
+        }
+
+    private:
+        uint8_t phase = 0;
+        int replies = 0;
+
+        template <typename Send>
+        void probe(Send&& send)
+        {
+            state = State::Participating;
+            replies = 0;
+            send(Message{ id, Message::Type::Probe, "", phase, 1 }, Side::Clockwise);
+            send(Message{ id, Message::Type::Probe, "", phase, 1 }, Side::CounterClockwise);
+        }
+    };
+
+    // Echo with extinction, for any connected graph whose nodes know their neighbors by port number:
+    // every node floods a wave of its own ID, and a node joins a larger wave and drops the smaller ones.
+    // A node echoes to the neighbor it joined from once every other neighbor answered, with an echo or with the same wave,
+    // so that only the wave of the largest ID comes back to its initiator, which then floods the result.
+    // The waves started at once, it takes about 3D hops on a graph of diameter D, 2D for the wave and D for the result,
+    // instead of the N of a ring, for 3E messages on E edges when the largest wave is first everywhere and O(NE) at worst.
+    // The probes count their hops from the initiator, for the log.
+    class EchoWave
+    {
+    public:
+        EchoWave(ID id, size_t degree) : id(id), degree(degree), wave(id) {}
+
+        auto getState() const { return state; }
+        auto getLeader() const { return leader; }
+        auto getFinished() const { return finished; }
+
+        // send(msg, port)
+        template <typename Send>
+        void start(Send&& send)
+        {
+            if (state != State::Offline)
+            {
+                return;
+            }
+            state = State::Participating;
+            join(id, nullopt, 0, send);
+        }
+
+        template <typename Send>
+        string receive(Message const& msg, size_t port, Send&& send)
+        {
+            if (finished)
+            {
+                return "noop, decided";
+            }
+            if (msg.type == Message::Type::ElectedLeader)
+            {
+                decide(msg.id, port, send);
+                return "forwarding";
+            }
+            if (state == State::Offline)
+            {
+                // woken up by a wave: the node starts its own unless it is already beaten
+                state = State::Participating;
+                if (msg.id < id || msg.type != Message::Type::Probe)
+                {
+                    join(id, nullopt, 0, send);
+                }
+            }
+            if (msg.type == Message::Type::Probe && msg.id > wave)
+            {
+                join(msg.id, port, msg.hops, send);
+                return "joining the wave of " + std::to_string(msg.id);
+            }
+            if ((msg.type == Message::Type::Probe || msg.type == Message::Type::Reply) && msg.id == wave)
+            {
+                // a probe of the same wave is the answer of a neighbor that already joined it from elsewhere
+                return answered(send);
+            }
+            return "noop, extinguished wave of " + std::to_string(msg.id);
+        }
+
+    private:
+        ID id;
+        size_t degree;
+        State state = State::Offline;
+        optional<ID> leader;
+        bool finished = false;
+        ID wave;                // the largest seen
+        optional<size_t> parent; // the port the wave came from, none for my own
+        size_t waiting = 0;      // for the answers of the other neighbors
+
+        template <typename Send>
+        void join(ID wave, optional<size_t> parent, uint32_t hops, Send& send)
+        {
+            this->wave = wave;
+            this->parent = parent;
+            waiting = degree - (parent ? 1 : 0);
+            for (size_t port=0; port<degree; ++port)
+            {
+                if (port != parent)
+                {
+                    send(Message{ wave, Message::Type::Probe, "", 0, hops + 1 }, port);
+                }
+            }
+            if (waiting == 0)
+            {
+                complete(send);
+            }
+        }
+
+        template <typename Send>
+        string answered(Send& send)
+        {
+            if (--waiting)
+            {
+                return "waiting for " + std::to_string(waiting) + " answers";
+            }
+            return complete(send);
+        }
+
+        template <typename Send>
+        string complete(Send& send)
+        {
+            if (parent)
+            {
+                send(Message{ wave, Message::Type::Reply, "" }, *parent);
+                return "echoing";
+            }
+            // my own wave came back from everywhere
+            decide(id, nullopt, send);
+            return "sending i am the leader";
+        }
+
+        template <typename Send>
+        void decide(ID elected, optional<size_t> from, Send& send)
+        {
+            leader = elected;
+            state = elected == id ? State::Leader : State::Decided;
+            finished = true;
+            for (size_t port=0; port<degree; ++port)
+            {
+                if (port != from)
+                {
+                    send(Message{ elected, Message::Type::ElectedLeader, "" }, port);
+                }
+            }
+        }
+    };
+
+    // the echo on a ring, a graph whose two ports are the two sides, after the same discovery as the other algorithms
+    class EchoRing : public RingMember
+    {
+    public:
+        explicit EchoRing(ID id) : RingMember(id), echo(id, 2) {}
+
+        template <typename Send>
+        string receive(Message msg, Side from, Send&& send)
+        {
+            auto actionDescription = string{};
+            if (greet(msg, send, actionDescription))
+            {
+                return actionDescription;
+            }
+            actionDescription = echo.receive(msg, port(from), sides(send));
+            update();
+            return actionDescription;
+        }
+
+        template <typename Send>
+        bool startIfReady(Send&& send)
+        {
+            if (state != State::Offline || allReady == false)
+            {
+                return false;
+            }
+            echo.start(sides(send));
+            update();
+            return true;
+        }
+
+    private:
+        EchoWave echo;
+
+        static size_t port(Side side) { return side == Side::Clockwise ? 0 : 1; }
+
+        template <typename Send>
+        static auto sides(Send& send)
+        {
+            return [&send] (Message const& msg, size_t port) { send(msg, port == 0 ? Side::Clockwise : Side::CounterClockwise); };
+        }
+
+        void update()
+        {
+            state = echo.getState();
+            leader = echo.getLeader();
+            finished = echo.getFinished();
+        }
+    };
+
+    // one of the algorithms above, chosen at run time
+    // Each election has an epoch, carried by its messages: when a node loses the leader it starts the next epoch,
+    // a node joins it, forgetting the previous leader, on its first message of that epoch,
+    // and the late messages of the previous epochs are ignored.
+    class Machine
+    {
+    public:
+        Machine(Algorithm algorithm, ID id) :
+            algorithm(algorithm),
+            id(id),
+            machine(make(algorithm, id))
+        {
+        }
+
+        // whether the algorithm sends counter-clockwise too
+        auto getBidirectional() const { return bidirectional(algorithm); }
+        auto getState() const { return member().getState(); }
+        auto getLeader() const { return member().getLeader(); }
+        auto getFinished() const { return member().getFinished(); }
+        auto getRingSize() const { return member().getRingSize(); }
+        auto getEpoch() const { return epoch; }
+
+        template <typename Send>
+        void start(Send&& send, Discovery discovery = Discovery::Flood, bool initiator = true)
+        {
+            std::visit([&] (auto& m) { m.start(stamped(send), discovery, initiator); }, machine);
+        }
+        template <typename Send>
+        string receive(Message const& msg, Side from, Send&& send)
+        {
+            if (msg.epoch < epoch)
+            {
+                return "noop, late from epoch " + std::to_string(msg.epoch);
+            }
+            auto actionDescription = string{};
+            if (msg.epoch > epoch)
+            {
+                restart(msg.epoch);
+                actionDescription = "joining epoch " + std::to_string(epoch) + ", ";
+            }
+            return actionDescription + std::visit([&] (auto& m) { return m.receive(msg, from, stamped(send)); }, machine);
+        }
+        void ready()
+        {
+            std::visit([] (auto& m) { m.ready(); }, machine);
+        }
+        template <typename Send>
+        bool startIfReady(Send&& send)
+        {
+            return std::visit([&] (auto& m) { return m.startIfReady(stamped(send)); }, machine);
+        }
+        // once the leader is lost: forgets it and starts the election of the next epoch
+        template <typename Send>
+        bool reelect(Send&& send)
+        {
+            restart(epoch + 1);
+            return startIfReady(send);
+        }
+
+    private:
+        Algorithm algorithm;
+        ID id;
+        uint32_t epoch = 0;
+        using Variant = variant<ChangRoberts, HirschbergSinclair, EchoRing>;
+        Variant machine;
+
+        static Variant make(Algorithm algorithm, ID id)
+        {
+            if (algorithm == Algorithm::HirschbergSinclair)
+            {
+                return Variant{in_place_type<HirschbergSinclair>, id};
+            }
+            if (algorithm == Algorithm::Echo)
+            {
+                return Variant{in_place_type<EchoRing>, id};
+            }
+            return Variant{in_place_type<ChangRoberts>, id};
+        }
+
+        // the ring is known to be up by now, there is no Greetings round in a later epoch
+        void restart(uint32_t epoch)
+        {
+            machine = make(algorithm, id);
+            ready();
+            this->epoch = epoch;
+        }
+
+        template <typename Send>
+        auto stamped(Send& send)
+        {
+            return [this, &send] (Message msg, Side side)
+            {
+                msg.epoch = epoch;
+                send(msg, side);
+            };
+        }
+
+        RingMember const& member() const
+        {
+            return std::visit([] (auto const& m) -> RingMember const& { return m; }, machine);
+        }
+    };
+
+    // What a node knows of a neighbor from its heartbeats, on a clock in seconds:
+    // the neighbor is suspected once it stays silent longer than the timeout,
+    // and a neighbor that was never heard, such as the one the ring was just spliced to, is not suspected.
+    class FailureDetector
+    {
+    public:
+        explicit FailureDetector(double timeout = 0) : timeout(timeout) {}
+
+        void heard(ID neighbor, double now)
+        {
+            this->neighbor = neighbor;
+            last = now;
+        }
+        optional<ID> suspect(double now) const
+        {
+            if (neighbor && now - last > timeout)
+            {
+                return neighbor;
+            }
+            return nullopt;
+        }
+        // the suspect was spliced out of the ring
+        void forget() { neighbor.reset(); }
+
+    private:
+        double timeout;
+        optional<ID> neighbor;
+        double last = 0;
+    };
+}
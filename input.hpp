@@ -0,0 +1,317 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// The ring description: a delay per node, in seconds, and optionally a fixed ID per node.
+// The text format may also give the edges of a graph. Both formats are read from a memory mapping and handed over node by node, nothing is copied in between,
+// so loading millions of nodes costs little more than reading the file.
+namespace input
+{
+    // text format, the original one:
+    //   the node count on the first line, then a delay per line
+    //   optionally followed by the edges of a graph to elect on instead of the ring:
+    //   "edges" and the edge count on a line, then the indices of the two ends of an edge per line
+    // binary format, integers and floats are little endian:
+    //   magic      4 bytes, "RING"
+    //   version    1 byte
+    //   flags      1 byte, withIDs when the IDs follow the delays
+    //   reserved   2 bytes, zero
+    //   count      8 bytes
+    //   delays     count IEEE 754 single precision floats
+    //   ids        count 8-byte unsigned integers, only withIDs
+    char constexpr magic[4] = { 'R', 'I', 'N', 'G' };
+    uint8_t constexpr version = 1;
+    uint8_t constexpr withIDs = 1;
+    size_t constexpr headerSize = 16;
+
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(filesystem::path const& path)
+        {
+            auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Failed to open: " + string{strerror(errno)});
+            }
+            struct stat status;
+            if (fstat(fd, &status) != 0)
+            {
+                auto const error = errno;
+                ::close(fd);
+                throw std::runtime_error("Failed to stat: " + string{strerror(error)});
+            }
+            size = static_cast<size_t>(status.st_size);
+            if (size)
+            {
+                auto const mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED)
+                {
+                    auto const error = errno;
+                    ::close(fd);
+                    throw std::runtime_error("Failed to map: " + string{strerror(error)});
+                }
+                data = static_cast<char const*>(mapping);
+                madvise(mapping, size, MADV_SEQUENTIAL);
+            }
+            ::close(fd);
+        }
+        ~MappedFile()
+        {
+            if (data)
+            {
+                munmap(const_cast<char*>(data), size);
+            }
+        }
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+
+        auto view() const { return string_view{data, size}; }
+
+    private:
+        char const* data = nullptr;
+        size_t size = 0;
+    };
+
+    auto isBinary(string_view file)
+    {
+        return file.size() >= sizeof magic && memcmp(file.data(), magic, sizeof magic) == 0;
+    }
+
+    template <typename T>
+    T little(char const* bytes)
+    {
+        auto in = reinterpret_cast<uint8_t const*>(bytes);
+        uint64_t ret = 0;
+        for (size_t i=0; i<sizeof(T); ++i)
+        {
+            ret |= static_cast<uint64_t>(in[i]) << (8 * i);
+        }
+        if constexpr (is_floating_point_v<T>)
+        {
+            static_assert(sizeof(T) == sizeof(uint32_t));
+            auto bits = static_cast<uint32_t>(ret);
+            T value;
+            memcpy(&value, &bits, sizeof value);
+            return value;
+        }
+        else
+        {
+            return static_cast<T>(ret);
+        }
+    }
+
+    // calls onCount(count, hasIDs) once, before anything else,
+    // then onNode(index, delay, id) for every node in ring order, the id only set when the file fixes it,
+    // then onEdge(a, b) for every edge, when the file has some
+    // throws a runtime_error naming the line, or the offset, of the first error
+    template <typename OnCount, typename OnNode, typename OnEdge>
+    void read(filesystem::path const& path, OnCount&& onCount, OnNode&& onNode, OnEdge&& onEdge)
+    {
+        auto fail = [&path] (string const& message)
+        {
+            throw std::runtime_error("Error '" + message + "' for path '" + path.string() + "'");
+        };
+
+        if (filesystem::exists(path) == false)
+        {
+            fail("Does not exist");
+        }
+        if (filesystem::is_directory(path))
+        {
+            fail("Is a directory");
+        }
+        if (filesystem::is_regular_file(path) == false)
+        {
+            fail("Not a regular file");
+        }
+        optional<MappedFile> mapped;
+        try
+        {
+            mapped.emplace(path);
+        }
+        catch (std::exception const& e)
+        {
+            fail(e.what());
+        }
+        auto const file = mapped->view();
+
+        if (isBinary(file))
+        {
+            if (file.size() < headerSize)
+            {
+                fail("Truncated header");
+            }
+            if (static_cast<uint8_t>(file[4]) != version)
+            {
+                fail("Unsupported binary input version " + std::to_string(static_cast<uint8_t>(file[4])));
+            }
+            auto const hasIDs = (file[5] & withIDs) != 0;
+            auto const count = little<uint64_t>(file.data() + 8);
+            auto const entrySize = sizeof(float) + (hasIDs ? sizeof(uint64_t) : 0);
+            if (count == 0)
+            {
+                fail("No election with zero voter");
+            }
+            if (count > (file.size() - headerSize) / entrySize || file.size() - headerSize != count * entrySize)
+            {
+                fail("Size does not match the count of " + std::to_string(count) + " nodes");
+            }
+            onCount(static_cast<size_t>(count), hasIDs);
+            auto const delays = file.data() + headerSize;
+            auto const ids = delays + count * sizeof(float);
+            for (size_t i=0; i<count; ++i)
+            {
+                auto const delay = little<float>(delays + i * sizeof(float));
+                onNode(i, delay, hasIDs ? optional<uint64_t>{little<uint64_t>(ids + i * sizeof(uint64_t))} : nullopt);
+            }
+            return;
+        }
+
+        auto position = file.data();
+        auto const end = file.data() + file.size();
+        size_t lineNumber = 0;
+        // the next line without its end of line, nothing when the file is over
+        auto nextLine = [&] () -> optional<string_view>
+        {
+            if (position == end)
+            {
+                return nullopt;
+            }
+            ++lineNumber;
+            auto const newline = static_cast<char const*>(memchr(position, '\n', end - position));
+            auto const lineEnd = newline ? newline : end;
+            auto line = string_view{position, static_cast<size_t>(lineEnd - position)};
+            position = newline ? newline + 1 : end;
+            return line;
+        };
+        // the number, alone on its line but for blanks around it
+        auto parse = [] (string_view line, auto& value)
+        {
+            auto const blank = " \t\r";
+            auto const first = line.find_first_not_of(blank);
+            if (first == string_view::npos)
+            {
+                return false;
+            }
+            auto const last = line.find_last_not_of(blank) + 1;
+            auto const [ptr, error] = std::from_chars(line.data() + first, line.data() + last, value);
+            return error == errc{} && ptr == line.data() + last;
+        };
+
+        auto line = nextLine();
+        if (!line)
+        {
+            fail("Failed to read first line");
+        }
+        size_t count = 0;
+        if (parse(*line, count) == false)
+        {
+            fail("Failed to parse count at line 1: " + string{*line});
+        }
+        if (count == 0)
+        {
+            fail("No election with zero voter");
+        }
+        onCount(count, false);
+        for (size_t i=0; i<count; ++i)
+        {
+            line = nextLine();
+            if (!line)
+            {
+                fail("Failed to read the delay of node with index " + std::to_string(i) + " expected at line " + std::to_string(i+2));
+            }
+            float delay = 0;
+            if (parse(*line, delay) == false)
+            {
+                fail("Failed to parse a floating-point number at line " + std::to_string(lineNumber));
+            }
+            onNode(i, delay, nullopt);
+        }
+
+        // anything else after the delays is ignored, as it always was
+        line = nextLine();
+        auto constexpr keyword = string_view{"edges"};
+        if (!line || line->substr(0, keyword.size()) != keyword)
+        {
+            return;
+        }
+        size_t edgeCount = 0;
+        if (parse(line->substr(keyword.size()), edgeCount) == false)
+        {
+            fail("Failed to parse the edge count at line " + std::to_string(lineNumber) + ": " + string{*line});
+        }
+        for (size_t i=0; i<edgeCount; ++i)
+        {
+            line = nextLine();
+            if (!line)
+            {
+                fail("Failed to read edge " + std::to_string(i) + " expected at line " + std::to_string(lineNumber + 1));
+            }
+            auto const first = line->find_first_not_of(" \t");
+            auto const separator = first == string_view::npos ? first : line->find_first_of(" \t", first);
+            size_t a = 0;
+            size_t b = 0;
+            if (separator == string_view::npos || parse(line->substr(0, separator), a) == false || parse(line->substr(separator), b) == false)
+            {
+                fail("Failed to parse two node indices at line " + std::to_string(lineNumber));
+            }
+            if (a >= count || b >= count)
+            {
+                fail("Node index out of the " + std::to_string(count) + " nodes at line " + std::to_string(lineNumber));
+            }
+            onEdge(a, b);
+        }
+    }
+
+    // writes the binary format, ids is either empty or as long as delays
+    void writeBinary(filesystem::path const& path, vector<float> const& delays, vector<uint64_t> const& ids)
+    {
+        auto put = [] (vector<char>& out, uint64_t value, size_t size)
+        {
+            for (size_t i=0; i<size; ++i)
+            {
+                out.push_back(static_cast<char>(value >> (8 * i)));
+            }
+        };
+        vector<char> out;
+        out.reserve(headerSize + delays.size() * sizeof(float) + ids.size() * sizeof(uint64_t));
+        out.insert(out.end(), std::begin(magic), std::end(magic));
+        out.push_back(static_cast<char>(version));
+        out.push_back(static_cast<char>(ids.empty() ? 0 : withIDs));
+        put(out, 0, 2);
+        put(out, delays.size(), sizeof(uint64_t));
+        for (auto delay: delays)
+        {
+            uint32_t bits;
+            memcpy(&bits, &delay, sizeof bits);
+            put(out, bits, sizeof bits);
+        }
+        for (auto id: ids)
+        {
+            put(out, id, sizeof id);
+        }
+        ofstream stream{path, ios_base::out | ios_base::binary | ios_base::trunc};
+        stream.write(out.data(), static_cast<streamsize>(out.size()));
+        if (!stream)
+        {
+            throw std::runtime_error("Failed to write '" + path.string() + "'");
+        }
+    }
+}
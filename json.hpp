@@ -1,30 +1,88 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <string>
 #include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 using namespace std;
 
 namespace json
 {
+    // fixed capacity string so that messages are trivially copyable and never allocate,
+    // longer strings are truncated, the parsers reject them instead
+    struct Value
+    {
+        static size_t constexpr capacity = 28;
+
+        Value() = default;
+        Value(char const* str) : Value(string_view{str}) {}
+        Value(string const& str) : Value(string_view{str}) {}
+        Value(string_view str)
+        {
+            length = static_cast<uint8_t>(std::min(str.size(), capacity));
+            memcpy(characters, str.data(), length);
+        }
+
+        auto size() const { return static_cast<size_t>(length); }
+        auto data() const { return characters; }
+        auto begin() const { return characters; }
+        auto end() const { return characters + length; }
+        auto view() const { return string_view{characters, length}; }
+        bool operator==(Value const& other) const { return view() == other.view(); }
+
+    private:
+        char characters[capacity];
+        uint8_t length = 0;
+    };
 
     struct Message
     {
-        enum struct Type
+        enum struct Type : uint8_t
         {
             Greetings,
             ElectionStart, // specified as "election-message" which is ambiguous
             ElectedLeader,
+            Probe, // Hirschberg-Sinclair: is the id the largest within 2^phase hops
+            Reply, // Hirschberg-Sinclair: it is, on the side the reply comes from
+            Heartbeat, // to both neighbors, which suspect the sender when they stop getting them
         };
-        uint16_t id;
+        static auto constexpr lastType = Type::Heartbeat;
+        uint64_t id; // the width actually used is chosen at startup, see --id-bits
         Type type;
-        string value; // question to specifier: what is this field used for?
+        Value value; // question to specifier: what is this field used for?
+        uint8_t phase = 0; // Probe and Reply only
+        uint32_t hops = 0; // Probe only
+        uint32_t epoch = 0; // the election the message belongs to, one more after each leader lost
     };
+    static_assert(is_trivially_copyable_v<Message>);
+
+    auto describe(Message::Type type)
+    {
+        switch (type)
+        {
+        case Message::Type::Greetings: return "Greetings";
+        case Message::Type::ElectionStart: return "ElectionStart";
+        case Message::Type::ElectedLeader: return "ElectedLeader";
+        case Message::Type::Probe: return "Probe";
+        case Message::Type::Reply: return "Reply";
+        case Message::Type::Heartbeat: return "Heartbeat";
+        }
+        return "Unknown";
+    }
 
     const string prefixID = "\t\"source\": ";
     const string prefixType = "\t\"type\": ";
     const string prefixValue = "\t\"value\": ";
+    const string prefixPhase = "\t\"phase\": ";
+    const string prefixHops = "\t\"hops\": ";
+    const string prefixEpoch = "\t\"epoch\": ";
 
     auto to_string(Message const& msg)
     {
@@ -32,44 +90,258 @@ namespace json
         ret << "{" << endl;
         ret << prefixID << std::to_string(msg.id) << "," << endl;
         ret << prefixType << std::to_string(static_cast<int>(msg.type)) << "," << endl;
-        ret << prefixValue << msg.value << endl;
+        if (msg.type == Message::Type::Probe || msg.type == Message::Type::Reply)
+        {
+            ret << prefixPhase << std::to_string(msg.phase) << "," << endl;
+            ret << prefixHops << std::to_string(msg.hops) << "," << endl;
+        }
+        if (msg.epoch)
+        {
+            ret << prefixEpoch << std::to_string(msg.epoch) << "," << endl;
+        }
+        ret << prefixValue << "\"";
+        for (auto c: msg.value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                ret << '\\';
+            }
+            ret << c;
+        }
+        ret << "\"" << endl;
         ret << "}";
         return ret.str();
     }
 
-    optional<Message> from_string(string const& str)
+    enum struct ParseError
+    {
+        None,
+        ExpectedObject,
+        ExpectedKey,
+        ExpectedColon,
+        ExpectedComma,
+        UnknownKey,
+        DuplicateKey,
+        MissingKey,
+        BadNumber,
+        BadType,
+        BadString,
+        ValueTooLong,
+        TrailingCharacters,
+    };
+
+    auto describe(ParseError error)
     {
-        try
-        {
-            Message msg;
-            istringstream iss{str};
-            string line;
-            if (!getline(iss, line)) { return {}; }
-            if (line != "{") { return {}; }
-            if (!getline(iss, line)) { return {}; }
-            auto posID = line.find(prefixID);
-            if (posID == string::npos) { return {}; }
-            posID = prefixID.size();
-            auto lineID = line.substr(posID, line.size() - posID);
-            msg.id = stoi(lineID);
-            if (!getline(iss, line)) { return {}; }
-            auto posType = line.find(prefixType);
-            if (posType == string::npos) { return {}; }
-            posType = prefixType.size();
-            auto lineType = line.substr(posType, line.size() - posType);
-            int type = stoi(lineType);
-            msg.type = static_cast<Message::Type>(type);
-            if (!getline(iss, line)) { return {}; }
-            auto posValue = line.find(prefixValue);
-            if (posValue == string::npos) { return {}; }
-            posValue = prefixValue.size();
-            auto lineValue = line.substr(posValue, line.size() - posValue);
-            msg.value = lineValue;
-            return msg;
+        switch (error)
+        {
+        case ParseError::None: return "none";
+        case ParseError::ExpectedObject: return "expected an object";
+        case ParseError::ExpectedKey: return "expected a key";
+        case ParseError::ExpectedColon: return "expected a colon";
+        case ParseError::ExpectedComma: return "expected a comma";
+        case ParseError::UnknownKey: return "unknown key";
+        case ParseError::DuplicateKey: return "duplicate key";
+        case ParseError::MissingKey: return "missing key";
+        case ParseError::BadNumber: return "bad number";
+        case ParseError::BadType: return "bad message type";
+        case ParseError::BadString: return "bad string";
+        case ParseError::ValueTooLong: return "value too long";
+        case ParseError::TrailingCharacters: return "trailing characters";
         }
-        catch (std::exception const&)
+        return "unknown error";
+    }
+
+    // a parsed message whose value points into the parsed text, still escaped
+    struct MessageView
+    {
+        decltype(Message::id) id = 0;
+        Message::Type type = Message::Type::Greetings;
+        string_view value;
+        decltype(Message::phase) phase = 0;
+        decltype(Message::hops) hops = 0;
+        decltype(Message::epoch) epoch = 0;
+
+        Message toMessage() const;
+    };
+
+    // accepts the keys in any order, any whitespace, and the value either quoted or bare as in older versions
+    // does not allocate nor throw
+    ParseError parse(string_view str, MessageView& view)
+    {
+        size_t pos = 0;
+        auto skipWhitespace = [&] ()
+        {
+            while (pos < str.size() && (str[pos] == ' ' || str[pos] == '\t' || str[pos] == '\n' || str[pos] == '\r'))
+            {
+                ++pos;
+            }
+        };
+        auto consume = [&] (char c)
+        {
+            skipWhitespace();
+            if (pos < str.size() && str[pos] == c)
+            {
+                ++pos;
+                return true;
+            }
+            return false;
+        };
+        // returns the content between the quotes, or an empty optional
+        auto quoted = [&] () -> optional<string_view>
+        {
+            if (consume('"') == false)
+            {
+                return {};
+            }
+            auto start = pos;
+            while (pos < str.size() && str[pos] != '"')
+            {
+                pos += (str[pos] == '\\') ? 2 : 1;
+            }
+            if (pos >= str.size())
+            {
+                return {};
+            }
+            return str.substr(start, pos++ - start);
+        };
+        auto number = [&] (auto& out)
+        {
+            skipWhitespace();
+            auto result = from_chars(str.data() + pos, str.data() + str.size(), out);
+            if (result.ec != errc{})
+            {
+                return false;
+            }
+            pos = result.ptr - str.data();
+            return true;
+        };
+
+        if (consume('{') == false)
+        {
+            return ParseError::ExpectedObject;
+        }
+        auto hasID = false, hasType = false, hasValue = false, hasPhase = false, hasHops = false, hasEpoch = false;
+        view = MessageView{};
+        while (consume('}') == false)
+        {
+            if ((hasID || hasType || hasValue || hasPhase || hasHops || hasEpoch) && consume(',') == false)
+            {
+                return ParseError::ExpectedComma;
+            }
+            auto key = quoted();
+            if (!key)
+            {
+                return ParseError::ExpectedKey;
+            }
+            if (consume(':') == false)
+            {
+                return ParseError::ExpectedColon;
+            }
+            if (*key == "source")
+            {
+                if (hasID) { return ParseError::DuplicateKey; }
+                if (number(view.id) == false) { return ParseError::BadNumber; }
+                hasID = true;
+            }
+            else if (*key == "type")
+            {
+                if (hasType) { return ParseError::DuplicateKey; }
+                int type = 0;
+                if (number(type) == false) { return ParseError::BadNumber; }
+                if (type < 0 || type > static_cast<int>(Message::lastType)) { return ParseError::BadType; }
+                view.type = static_cast<Message::Type>(type);
+                hasType = true;
+            }
+            else if (*key == "value")
+            {
+                if (hasValue) { return ParseError::DuplicateKey; }
+                skipWhitespace();
+                if (pos < str.size() && str[pos] == '"')
+                {
+                    auto value = quoted();
+                    if (!value) { return ParseError::BadString; }
+                    view.value = *value;
+                }
+                else
+                {
+                    // bare value up to the end of the line or of the object
+                    auto start = pos;
+                    while (pos < str.size() && str[pos] != '\n' && str[pos] != ',' && str[pos] != '}')
+                    {
+                        ++pos;
+                    }
+                    auto end = pos;
+                    while (end > start && (str[end - 1] == ' ' || str[end - 1] == '\t' || str[end - 1] == '\r'))
+                    {
+                        --end;
+                    }
+                    view.value = str.substr(start, end - start);
+                }
+                if (view.value.size() > Value::capacity) { return ParseError::ValueTooLong; }
+                hasValue = true;
+            }
+            else if (*key == "phase")
+            {
+                if (hasPhase) { return ParseError::DuplicateKey; }
+                if (number(view.phase) == false) { return ParseError::BadNumber; }
+                hasPhase = true;
+            }
+            else if (*key == "hops")
+            {
+                if (hasHops) { return ParseError::DuplicateKey; }
+                if (number(view.hops) == false) { return ParseError::BadNumber; }
+                hasHops = true;
+            }
+            else if (*key == "epoch")
+            {
+                if (hasEpoch) { return ParseError::DuplicateKey; }
+                if (number(view.epoch) == false) { return ParseError::BadNumber; }
+                hasEpoch = true;
+            }
+            else
+            {
+                return ParseError::UnknownKey;
+            }
+        }
+        skipWhitespace();
+        if (pos != str.size())
+        {
+            return ParseError::TrailingCharacters;
+        }
+        if (hasID == false || hasType == false)
+        {
+            return ParseError::MissingKey;
+        }
+        return ParseError::None;
+    }
+
+    auto unescape(string_view value)
+    {
+        string ret;
+        ret.reserve(value.size());
+        for (size_t i=0; i<value.size(); ++i)
+        {
+            if (value[i] == '\\' && i + 1 < value.size())
+            {
+                ++i;
+            }
+            ret += value[i];
+        }
+        return ret;
+    }
+
+    Message MessageView::toMessage() const
+    {
+        return Message{ id, type, unescape(value), phase, hops, epoch };
+    }
+
+    optional<Message> from_string(string_view str)
+    {
+        MessageView view;
+        if (parse(str, view) != ParseError::None)
         {
             return {};
         }
+        return view.toMessage();
     }
 }
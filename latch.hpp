@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+using namespace std;
+
+// Counts down once to zero and then releases every thread waiting on it, like std::latch of C++20.
+class Latch
+{
+public:
+    explicit Latch(size_t count) : count(count) {}
+
+    void countDown()
+    {
+        lock_guard<mutex> guard{lock};
+        if (count && --count == 0)
+        {
+            zero.notify_all();
+        }
+    }
+
+    void wait()
+    {
+        unique_lock<mutex> guard{lock};
+        zero.wait(guard, [this] { return count == 0; });
+    }
+
+    // returns whether the count reached zero before the timeout
+    template <typename Duration>
+    bool waitFor(Duration timeout)
+    {
+        unique_lock<mutex> guard{lock};
+        return zero.wait_for(guard, timeout, [this] { return count == 0; });
+    }
+
+private:
+    mutex lock;
+    condition_variable zero;
+    size_t count;
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "spsc.hpp"
+
+using namespace std;
+
+// Asynchronous log: each thread appends its lines to its own lock-free queue
+// and a single writer thread drains them in batches to the console and to a file that stays open.
+namespace logging
+{
+    enum struct Level
+    {
+        Off,
+        Error,
+        Info,  // node lifecycle and the election result
+        Debug, // one line per message
+    };
+
+    struct Line
+    {
+        static size_t constexpr capacity = 247;
+        uint8_t size;
+        char text[capacity];
+    };
+
+    class Logger
+    {
+    public:
+        static Logger& instance()
+        {
+            static Logger logger;
+            return logger;
+        }
+
+        bool enabled(Level level) const
+        {
+            return level != Level::Off && level <= this->level.load(memory_order_relaxed);
+        }
+
+        void start(filesystem::path const& path, Level level, bool console)
+        {
+            stop();
+            this->level = level;
+            this->console = console;
+            file.open(path, ios_base::out | ios_base::trunc);
+            stopping = false;
+            writer = thread{&Logger::write, this};
+        }
+
+        // writes what is queued and closes the file
+        void stop()
+        {
+            if (writer.joinable() == false)
+            {
+                return;
+            }
+            level = Level::Off;
+            stopping = true;
+            writer.join();
+            file.close();
+        }
+
+        // lines longer than Line::capacity are truncated
+        void append(string_view text)
+        {
+            Line line;
+            line.size = static_cast<uint8_t>(std::min(text.size(), Line::capacity));
+            memcpy(line.text, text.data(), line.size);
+            auto& queue = buffer().queue;
+            // waits for the writer when the queue is full, unless it has stopped
+            while (queue.tryPush(line) == false)
+            {
+                if (level.load(memory_order_relaxed) == Level::Off)
+                {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        ~Logger() { stop(); }
+
+    private:
+        struct ThreadBuffer
+        {
+            SpscQueue<Line, 128> queue;
+            atomic<bool> retired{false}; // the thread exited, drop the buffer once drained
+        };
+        // unregisters the buffer of a thread when the thread exits
+        struct Registration
+        {
+            shared_ptr<ThreadBuffer> buffer;
+            ~Registration() { buffer->retired = true; }
+        };
+
+        atomic<Level> level{Level::Off}; // nothing is logged until start()
+        bool console = true;
+        ofstream file;
+        atomic<bool> stopping{false};
+        thread writer;
+        mutex registryLock; // only taken when a thread logs for the first time, and by the writer
+        vector<shared_ptr<ThreadBuffer>> registry;
+
+        ThreadBuffer& buffer()
+        {
+            thread_local Registration registration = [this] ()
+            {
+                auto buffer = make_shared<ThreadBuffer>();
+                lock_guard<mutex> guard{registryLock};
+                registry.emplace_back(buffer);
+                return Registration{buffer};
+            }();
+            return *registration.buffer;
+        }
+
+        void write()
+        {
+            string batch;
+            vector<shared_ptr<ThreadBuffer>> buffers;
+            while (true)
+            {
+                // read the flag first so that the lines queued before stop() are all written
+                auto const last = stopping.load();
+                {
+                    lock_guard<mutex> guard{registryLock};
+                    buffers = registry;
+                }
+                for (auto const& buffer: buffers)
+                {
+                    while (auto line = buffer->queue.pop())
+                    {
+                        batch.append(line->text, line->size);
+                        batch += '\n';
+                    }
+                }
+                if (batch.size())
+                {
+                    if (console)
+                    {
+                        cout << batch << flush;
+                    }
+                    file << batch << flush;
+                    batch.clear();
+                }
+                {
+                    lock_guard<mutex> guard{registryLock};
+                    registry.erase(std::remove_if(registry.begin(), registry.end(), [] (auto const& buffer) {
+                        return buffer->retired && buffer->queue.size() == 0; }), registry.end());
+                }
+                if (last)
+                {
+                    return;
+                }
+                std::this_thread::sleep_for(10ms);
+            }
+        }
+    };
+
+    auto enabled(Level level) { return Logger::instance().enabled(level); }
+    void write(string_view text) { Logger::instance().append(text); }
+    void start(filesystem::path const& path, Level level, bool console) { Logger::instance().start(path, level, console); }
+    void stop() { Logger::instance().stop(); }
+}
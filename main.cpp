@@ -4,689 +4,2382 @@
 #include <fstream>
 #include <limits>
 #include <vector>
-// #include <random>
 #include <chrono>
 #include <set>
 #include<thread>
 #include <mutex>
+#include <condition_variable>
 #include <queue>
-// #include <sys/socket.h> ouch no!
-// QT sockets: sudo apt install qt6-base-dev
-#include <QTcpSocket>
-#include <QTcpServer>
+#include <deque>
+#include <algorithm>
+#include <array>
+#include <random>
+#include <numeric>
+#include <optional>
+#include <cinttypes>
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "json.hpp"
+#include "election.hpp"
+#include "pool.hpp"
+#include "simulation.hpp"
+#include "wire.hpp"
+#include "spsc.hpp"
+#include "logger.hpp"
+#include "transport.hpp"
+#include "qttransport.hpp"
+#include "unixtransport.hpp"
+#include "metrics.hpp"
+#include "timerwheel.hpp"
+#include "latch.hpp"
+#include "permutation.hpp"
+#include "input.hpp"
+#include "analysis.hpp"
+#include "trace.hpp"
+#include "topology.hpp"
 
 using namespace std;
 using namespace json;
 
 namespace Limits
 {
-    using IDType = uint16_t;
-    auto constexpr LowerBound = std::numeric_limits<IDType>::min();
-    auto constexpr UpperBound = std::numeric_limits<IDType>::max();
+    using IDType = decltype(Message::id);
+    auto constexpr MaxIDBits = std::numeric_limits<IDType>::digits;
+}
+
+// how the IDs are laid out clockwise around the ring
+enum struct IDOrder
+{
+    Clock,      // derived from the clock, see generateID, may collide
+    Random,     // distinct and shuffled, see permutation::Feistel
+    Ascending,  // distinct, every election message but the largest is dropped by the next node
+    Descending, // distinct, the worst case of Chang-Roberts
+};
+
+enum struct Runtime
+{
+    Threads, // two threads and two sockets per node, three and four when the algorithm sends both ways, and a shared timer wheel but over Qt
+    Pool,    // all nodes on a fixed set of workers, see pool.hpp
+    Simulation, // virtual clock, no threads nor sockets, see simulation.hpp
+    Processes,  // the threads runtime in a process per shard of nodes, over TCP or UNIX sockets, see launch
+};
+
+struct Options
+{
+    filesystem::path inputPath;
+    Runtime runtime = Runtime::Threads;
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t processes = 0; // one per node when 0
+    wire::Format wire = wire::Format::Binary;
+    transport::Kind transport = transport::Kind::Tcp;
+    logging::Level logLevel = logging::Level::Debug;
+    election::Algorithm algorithm = election::Algorithm::ChangRoberts;
+    election::Discovery discovery = election::Discovery::Sweep; // pool and simulation, the others know from their latches
+    IDOrder ids = IDOrder::Random;
+    int idBits = 32;
+    optional<uint64_t> seed; // of the ID permutation, random when not given
+    filesystem::path reportPath; // no report when empty
+    string label;                // first column of the report, such as the commit
+    filesystem::path metricsPath; // JSON snapshot of the node metrics, at the end and on SIGUSR1
+    filesystem::path convertPath; // writes the input in the binary format there instead of electing
+    bool convertIDs = false;      // and the IDs too, to replay a run with the same ring
+    simulation::Crashes crashes;  // failover mode of the simulation
+    size_t trials = 0;            // analysis mode: that many simulated elections on random rings instead of one
+    filesystem::path tracePath;   // binary trace of the nodes, see trace.hpp, none when empty
+    filesystem::path replayPath;  // replays this trace instead of electing, no input file is needed then
+    filesystem::path chromePath;  // and converts it to the Chrome trace-event format
+    topology::Spec topology;      // anything but the ring needs the echo in the simulation or the analysis
+    optional<size_t> hierarchy;   // nodes per sub-ring of the hierarchical mode, about sqrt(N) when 0, see simulation::runHierarchy
+};
+
+// the runtimes with links wire a ring, only the echo elects on other graphs
+void checkGraphOptions(Options const& options)
+{
+    if (options.algorithm != election::Algorithm::Echo)
+    {
+        throw std::runtime_error("A topology other than the ring needs --algorithm echo");
+    }
+    if (options.runtime != Runtime::Simulation && options.trials == 0)
+    {
+        throw std::runtime_error("A topology other than the ring needs --runtime simulation or --analyze");
+    }
+    if (options.crashes.leaders)
+    {
+        throw std::runtime_error("--crash-leaders splices a ring, it needs --topology ring");
+    }
 }
 
 auto parseCommandLine(int argc, char** argv)
 {
-    if (argc != 2)
+    auto usage = string{"Usage: "} + string{argv[0]} +
+        string{" <input-file> [--runtime threads|pool|simulation|processes] [--workers <count>] [--processes <count>]" +
+        string{" [--wire binary|text]"} +
+        string{" [--transport tcp|inprocess|unix|socketpair]"} +
+        string{" [--log-level off|error|info|debug]"} +
+        string{" [--algorithm chang-roberts|hirschberg-sinclair|echo] [--discovery flood|sweep]"} +
+        string{" [--ids clock|random|ascending|descending] [--id-bits <1-64>] [--seed <number>]"} +
+        string{" [--report <csv-file>] [--label <text>]"} +
+        string{" [--metrics <json-file>] [--convert <binary-file>] [--convert-with-ids <binary-file>]"} +
+        string{" [--crash-leaders <count>] [--heartbeat <seconds>] [--failure-timeout <seconds>]"} +
+        string{" [--analyze <trials>] [--trace <trace-file>]"} +
+        string{" [--topology ring|torus[:<rows>]|tree[:<arity>]|regular[:<degree>]] [--hierarchy <nodes-per-sub-ring>]"} +
+        string{"\n   or: "} + string{argv[0]} + string{" --replay <trace-file> [--chrome <json-file>]"} +
+        string{"\n   or: "} + string{argv[0]} + string{" --unit-tests"}};
+    if (argc < 2)
+    {
+        throw std::runtime_error(usage);
+    }
+    Options options;
+    auto first = 1;
+    if (string_view{argv[1]}.substr(0, 2) != "--")
+    {
+        options.inputPath = filesystem::path{string{argv[1]}};
+        first = 2;
+    }
+    for (int i=first; i<argc; ++i)
+    {
+        auto option = string{argv[i]};
+        if (i + 1 >= argc)
+        {
+            throw std::runtime_error("Missing value for " + option + "\n" + usage);
+        }
+        auto value = string{argv[++i]};
+        if (option == "--runtime" && value == "threads")
+        {
+            options.runtime = Runtime::Threads;
+        }
+        else if (option == "--runtime" && value == "pool")
+        {
+            options.runtime = Runtime::Pool;
+        }
+        else if (option == "--runtime" && value == "simulation")
+        {
+            options.runtime = Runtime::Simulation;
+        }
+        else if (option == "--runtime" && value == "processes")
+        {
+            options.runtime = Runtime::Processes;
+        }
+        else if (option == "--wire" && value == "binary")
+        {
+            options.wire = wire::Format::Binary;
+        }
+        else if (option == "--wire" && value == "text")
+        {
+            options.wire = wire::Format::Text;
+        }
+        else if (option == "--transport" && value == "tcp")
+        {
+            options.transport = transport::Kind::Tcp;
+        }
+        else if (option == "--transport" && value == "inprocess")
+        {
+            options.transport = transport::Kind::InProcess;
+        }
+        else if (option == "--transport" && value == "unix")
+        {
+            options.transport = transport::Kind::Unix;
+        }
+        else if (option == "--transport" && value == "socketpair")
+        {
+            options.transport = transport::Kind::SocketPair;
+        }
+        else if (option == "--log-level" && value == "off")
+        {
+            options.logLevel = logging::Level::Off;
+        }
+        else if (option == "--log-level" && value == "error")
+        {
+            options.logLevel = logging::Level::Error;
+        }
+        else if (option == "--log-level" && value == "info")
+        {
+            options.logLevel = logging::Level::Info;
+        }
+        else if (option == "--log-level" && value == "debug")
+        {
+            options.logLevel = logging::Level::Debug;
+        }
+        else if (option == "--algorithm" && value == "chang-roberts")
+        {
+            options.algorithm = election::Algorithm::ChangRoberts;
+        }
+        else if (option == "--algorithm" && value == "hirschberg-sinclair")
+        {
+            options.algorithm = election::Algorithm::HirschbergSinclair;
+        }
+        else if (option == "--algorithm" && value == "echo")
+        {
+            options.algorithm = election::Algorithm::Echo;
+        }
+        else if (option == "--discovery" && value == "flood")
+        {
+            options.discovery = election::Discovery::Flood;
+        }
+        else if (option == "--discovery" && value == "sweep")
+        {
+            options.discovery = election::Discovery::Sweep;
+        }
+        else if (option == "--ids" && value == "clock")
+        {
+            options.ids = IDOrder::Clock;
+        }
+        else if (option == "--ids" && value == "random")
+        {
+            options.ids = IDOrder::Random;
+        }
+        else if (option == "--ids" && value == "ascending")
+        {
+            options.ids = IDOrder::Ascending;
+        }
+        else if (option == "--ids" && value == "descending")
+        {
+            options.ids = IDOrder::Descending;
+        }
+        else if (option == "--id-bits")
+        {
+            try
+            {
+                options.idBits = std::stoi(value);
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse ID width: " + value);
+            }
+            if (options.idBits < 1 || options.idBits > Limits::MaxIDBits)
+            {
+                throw std::runtime_error("ID width out of 1 to " + std::to_string(Limits::MaxIDBits) + " bits: " + value);
+            }
+        }
+        else if (option == "--seed")
+        {
+            try
+            {
+                options.seed = std::stoull(value, nullptr, 0);
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse seed: " + value);
+            }
+        }
+        else if (option == "--report")
+        {
+            options.reportPath = value;
+        }
+        else if (option == "--metrics")
+        {
+            options.metricsPath = value;
+        }
+        else if (option == "--convert" || option == "--convert-with-ids")
+        {
+            options.convertPath = value;
+            options.convertIDs = option == "--convert-with-ids";
+        }
+        else if (option == "--label")
+        {
+            options.label = value;
+        }
+        else if (option == "--topology")
+        {
+            auto const colon = value.find(':');
+            auto const name = value.substr(0, colon);
+            auto& spec = options.topology;
+            spec.kind =
+                name == "ring" ? topology::Kind::Ring :
+                name == "torus" ? topology::Kind::Torus :
+                name == "tree" ? topology::Kind::Tree :
+                name == "regular" ? topology::Kind::Regular : topology::Kind::Edges;
+            try
+            {
+                if (spec.kind == topology::Kind::Edges)
+                {
+                    throw std::runtime_error(name);
+                }
+                spec.parameter = colon == string::npos ? 0 : std::stoul(value.substr(colon + 1));
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse topology: " + value + "\n" + usage);
+            }
+        }
+        else if (option == "--hierarchy")
+        {
+            try
+            {
+                options.hierarchy = std::stoul(value);
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse sub-ring size: " + value);
+            }
+        }
+        else if (option == "--trace")
+        {
+            options.tracePath = value;
+        }
+        else if (option == "--replay")
+        {
+            options.replayPath = value;
+        }
+        else if (option == "--chrome")
+        {
+            options.chromePath = value;
+        }
+        else if (option == "--crash-leaders" || option == "--heartbeat" || option == "--failure-timeout")
+        {
+            try
+            {
+                if (option == "--crash-leaders")
+                {
+                    options.crashes.leaders = std::stoul(value);
+                }
+                else if (option == "--heartbeat")
+                {
+                    options.crashes.heartbeat = std::stod(value);
+                }
+                else
+                {
+                    options.crashes.timeout = std::stod(value);
+                }
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse " + option + ": " + value);
+            }
+        }
+        else if (option == "--processes")
+        {
+            try
+            {
+                options.processes = std::stoul(value);
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse process count: " + value);
+            }
+        }
+        else if (option == "--analyze")
+        {
+            try
+            {
+                options.trials = std::stoul(value);
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse trial count: " + value);
+            }
+        }
+        else if (option == "--workers")
+        {
+            try
+            {
+                options.workers = std::stoul(value);
+            }
+            catch (std::exception const&)
+            {
+                throw std::runtime_error("Failed to parse worker count: " + value);
+            }
+            if (options.workers < 1)
+            {
+                throw std::runtime_error("Worker count below 1: " + value);
+            }
+        }
+        else
+        {
+            throw std::runtime_error("Unknown option " + option + " " + value + "\n" + usage);
+        }
+    }
+    if (options.inputPath.empty() && options.replayPath.empty())
+    {
+        throw std::runtime_error(usage);
+    }
+    if (options.tracePath.empty() == false && (options.runtime == Runtime::Simulation || options.trials))
+    {
+        throw std::runtime_error("--trace records the nodes of the threads, pool and processes runtimes, the simulation has none");
+    }
+    if (options.chromePath.empty() == false && options.replayPath.empty())
+    {
+        throw std::runtime_error("--chrome converts the trace given to --replay");
+    }
+    if (options.topology.kind != topology::Kind::Ring)
+    {
+        checkGraphOptions(options);
+    }
+    if (options.hierarchy && ((options.runtime != Runtime::Simulation && options.trials == 0) ||
+        options.crashes.leaders || options.topology.kind != topology::Kind::Ring))
+    {
+        // the levels are simulated one after the other
+        throw std::runtime_error("--hierarchy needs --runtime simulation or --analyze, on a ring and without --crash-leaders");
+    }
+    if (options.crashes.leaders && options.runtime != Runtime::Simulation)
+    {
+        // the other runtimes have their links set up once and for all
+        throw std::runtime_error("--crash-leaders needs --runtime simulation, the only runtime that splices the ring");
+    }
+    if (options.crashes.heartbeat <= 0 || options.crashes.timeout <= options.crashes.heartbeat)
+    {
+        throw std::runtime_error("The failure timeout must be longer than the heartbeat interval");
+    }
+    return options;
+}
+
+// the legacy IDs, kept to show why they are not used by default
+Limits::IDType generateID(int bits)
+{
+    /* random number : no guarantee on uniqueness
+        static std::mt19937 random_generator = [] () {
+            auto ret = std::mt19937 { std::random_device{}() };
+            ret.seed(time(0));
+            return ret;
+        }();
+
+        std::uniform_int_distribution<ID> distrib { Limits::LowerBound, Limits::UpperBound };
+        return distrib(random_generator);
+        */
+
+    static std::chrono::_V2::high_resolution_clock clock;
+    auto ticks = static_cast<uint64_t>(clock.now().time_since_epoch().count());
+    ticks *= ticks; // so that it's not so neatly ordered
+    ticks %= permutation::Feistel{bits, 0}.getMax();
+    // std::cout << "clock " << ticks << std::endl;
+    return ticks;
+}
+
+// distinct by construction, the images of the node indexes by a permutation of the ID space,
+// so no ID has to be checked against the others
+auto generateIDs(size_t count, IDOrder order, int bits, uint64_t seed)
+{
+    vector<Limits::IDType> ret;
+    ret.reserve(count);
+    if (order == IDOrder::Clock)
+    {
+        for (size_t i=0; i<count; ++i)
+        {
+            ret.emplace_back(generateID(bits));
+        }
+        return ret;
+    }
+    auto const permute = permutation::Feistel{bits, seed};
+    if (count - 1 > permute.getMax())
+    {
+        throw std::runtime_error("Not enough distinct " + std::to_string(bits) + "-bit IDs for " + std::to_string(count) + " nodes");
+    }
+    for (size_t i=0; i<count; ++i)
+    {
+        ret.emplace_back(permute(i));
+    }
+    if (order == IDOrder::Ascending)
+    {
+        std::sort(ret.begin(), ret.end());
+    }
+    else if (order == IDOrder::Descending)
+    {
+        std::sort(ret.begin(), ret.end(), std::greater<>{});
+    }
+    return ret;
+}
+
+class Node
+{
+private:
+    using ID = Limits::IDType;
+    // endpoints are numbered like the nodes, each transport names them its own way
+    static auto generateEndpoint()
+    {
+        static int next = 0;
+        return next++;
+    }
+    static auto tcpPort(int endpoint)
+    {
+        auto constexpr firstPort = 1025;
+        auto port = firstPort + endpoint;
+        if (port > std::numeric_limits<uint16_t>::max())
+        {
+            throw std::runtime_error("No TCP port left for endpoint " + to_string(endpoint) + ", use --transport unix");
+        }
+        return port;
+    }
+public:
+    Node(ID id, float delay, election::Algorithm algorithm, election::Discovery discovery = election::Discovery::Flood) :
+        id(id),
+        endpoint(generateEndpoint()),
+        delay(delay),
+        discovery(discovery),
+        election(algorithm, id)
+    {
+    }
+    // talks to the neighbor on the given side on the first endpoint, and listens to it on the second one
+    void link(election::Side side, int talkEndpoint, int listenEndpoint)
+    {
+        auto& link = links[index(side)];
+        link.endpoint = talkEndpoint;
+        link.neighborEndpoint = listenEndpoint;
+        link.used = true;
+    }
+    // a message on its way to a neighbor, held by the timer wheel until the link delay has passed
+    struct Outgoing
+    {
+        Node* node;
+        size_t link;
+        Message message;
+        metrics::Clock::time_point scheduled;
+    };
+    using Wheel = timing::TimerWheel<Outgoing>;
+
+    // releases the messages due, for the Wheel shared by all the nodes: one write per link
+    static void release(vector<Outgoing>& due)
+    {
+        vector<pair<Node*, size_t>> flushed;
+        auto const now = metrics::Clock::now();
+        for (auto const& outgoing: due)
+        {
+            auto& node = *outgoing.node;
+            auto& link = node.links[outgoing.link];
+            if (link.batch.empty())
+            {
+                flushed.emplace_back(&node, outgoing.link);
+            }
+            link.batch.push_back(outgoing.message);
+            node.stats->queues->linkWait.record(metrics::microseconds(now - outgoing.scheduled));
+            node.stats->queues->pending.fetch_sub(1, memory_order_relaxed);
+        }
+        for (auto [node, link]: flushed)
+        {
+            node->flush(node->links[link]);
+        }
+    }
+
+    // the whole ring listens before anyone connects, and is connected before anyone sends,
+    // so that nodes neither sleep nor wait on a timeout for their neighbors
+    // when the ring is spread over processes, the first thread past a latch also waits at the gate for the other processes
+    struct Startup
+    {
+        using Gate = function<void(char step)>;
+        explicit Startup(size_t linkCount, Gate gate = {}) : listening(linkCount), connected(linkCount), gate(std::move(gate)) {}
+        Latch listening;
+        Latch connected;
+
+        void waitListening() { wait(listening, listened, 'L'); }
+        void waitConnected() { wait(connected, joined, 'C'); }
+
+    private:
+        Gate gate;
+        once_flag listened;
+        once_flag joined;
+
+        void wait(Latch& latch, once_flag& once, char step)
+        {
+            latch.wait();
+            if (gate)
+            {
+                // the other threads block in call_once until the gate opens
+                std::call_once(once, gate, step);
+            }
+        }
+    };
+
+    // runs the node on its own threads and sockets, its messages are released by the wheel
+    void start(transport::Kind kind, wire::Format wireFormat, Wheel& wheel, Startup& startup)
+    {
+        auto report = [this] (logging::Level level, string_view message) { print(level, message); };
+        // the listen threads of both links wake up the process thread
+        auto doorbell = make_shared<Doorbell>();
+        for (auto& link: links)
+        {
+            if (link.used == false)
+            {
+                continue;
+            }
+            if (kind == transport::Kind::InProcess)
+            {
+                link.sender = make_shared<transport::InProcess::Sender>(link.endpoint);
+                link.receiver = make_shared<transport::InProcess::Receiver>(link.neighborEndpoint);
+            }
+            else if (kind == transport::Kind::Unix)
+            {
+                link.sender = make_shared<transport::Native::UnixSender>(link.endpoint, report);
+                link.receiver = make_shared<transport::Native::UnixReceiver>(link.neighborEndpoint, report);
+            }
+            else if (kind == transport::Kind::SocketPair)
+            {
+                link.sender = make_shared<transport::Native::PairSender>(link.endpoint, report);
+                link.receiver = make_shared<transport::Native::PairReceiver>(link.neighborEndpoint, report);
+            }
+            else
+            {
+                link.sender = make_shared<transport::QtTcp::Sender>(tcpPort(link.endpoint), wireFormat, report);
+                link.receiver = make_shared<transport::QtTcp::Receiver>(tcpPort(link.neighborEndpoint), wireFormat, report);
+            }
+            link.receiveQueue = make_shared<MessageQueue>(doorbell);
+        }
+        this->doorbell = doorbell;
+        // a QObject belongs to the thread that made it: the process thread connects, writes and closes the Qt sockets,
+        // and holds the messages of the node until they are due instead of the wheel
+        this->wheel = kind == transport::Kind::Tcp ? nullptr : &wheel;
+        this->startup = &startup;
+        stats->queues = make_unique<metrics::QueueMetrics>();
+        processThread = std::make_shared<thread>(&Node::process, this);
+    }
+    void printDescription() const
+    {
+        for (auto const& link: links)
+        {
+            if (link.used)
+            {
+                ostringstream s;
+                s << "Starting to talk on endpoint " << link.endpoint <<  " and to listen to " << link.neighborEndpoint <<  " with delay " << delay;
+                print(logging::Level::Info, s.str());
+            }
+        }
+    }
+    auto getEndpoint() const { return endpoint; }
+    auto getID() const { return id; }
+    auto getDelay() const { return delay; }
+    // read by the main thread while the process thread runs
+    auto getFinished() const { return finished->load(memory_order_acquire); }
+    // counts the latch down once, when the node learns the leader
+    void reportDecision(Latch& decisions) { this->decisions = &decisions; }
+    auto getLeader() const { return election.getLeader(); }
+    auto const& getMetrics() const { return *stats; }
+    auto getMessagesSent() const
+    {
+        uint64_t ret = 0;
+        for (auto const& count: stats->sent)
+        {
+            ret += count.load(memory_order_relaxed);
+        }
+        return ret;
+    }
+    // what the transports carried, or the size of the binary frames when there is no transport
+    auto getBytesSent() const { return stats->bytesSent.load(memory_order_relaxed); }
+    // once every node decided and the wheel is drained, the neighbors' listen threads then see the end of their stream
+    // the process thread of a node off the wheel disconnects on its own
+    void disconnect()
+    {
+        if (wheel == nullptr)
+        {
+            return;
+        }
+        for (auto& link: links)
+        {
+            if (link.connected)
+            {
+                link.sender->disconnect();
+                link.connected = false;
+            }
+        }
+    }
+    void join()
+    {
+        if (processThread)
+        {
+            processThread->join();
+        }
+        for (auto const& link: links)
+        {
+            if (link.listenThread)
+            {
+                link.listenThread->join();
+            }
+        }
+    }
+
+    // the steps of the state machine, driven either by process() or by a runtime::Pool
+    template <typename Send>
+    void begin(Send&& send, bool initiator)
+    {
+        if (trace::enabled())
+        {
+            trace::record(trace::beginEvent(endpoint, trace::Kind::Begin, initiator));
+        }
+        enter();
+        election.start(counted(send), discovery, initiator);
+    }
+    // when the runtime already knows that the whole ring is up, no Greetings round is needed
+    template <typename Send>
+    void beginReady(Send&& send)
+    {
+        if (trace::enabled())
+        {
+            trace::record(trace::beginEvent(endpoint, trace::Kind::BeginReady));
+        }
+        enter();
+        election.ready();
+        if (election.startIfReady(counted(send)))
+        {
+            print(logging::Level::Info, "the ring is up, starting an election");
+        }
+        enter();
+    }
+    template <typename Send>
+    void receive(Message const& msg, election::Side from, Send&& send)
+    {
+        if (trace::enabled())
+        {
+            trace::record(trace::messageEvent(trace::Kind::Receive, endpoint, msg, from));
+        }
+        stats->countReceived(msg);
+        auto const previousState = election.getState();
+        auto stateDescription =
+            string{"participating:"} +
+            ((election.getState() == election::State::Participating) ? "yes" : "no");
+        auto actionDescription = election.receive(msg, from, counted(send));
+        if (logging::enabled(logging::Level::Debug))
+        {
+            printMessage(msg, Direction::Receive, stateDescription + ", " + actionDescription);
+        }
+        if (election.getFinished())
+        {
+            print(logging::Level::Info, "OUR LEADER IS " + to_string(*election.getLeader()));
+            if (finished->exchange(true, memory_order_acq_rel) == false && decisions)
+            {
+                decisions->countDown();
+            }
+        }
+        if (election.startIfReady(counted(send)))
+        {
+            print(logging::Level::Info, "noticed lack of a leader, " + stateDescription + ", starting an election");
+        }
+        if (election.getState() != previousState)
+        {
+            enter();
+        }
+    }
+
+    void print(logging::Level level, string_view message) const
+    {
+        if (logging::enabled(level) == false)
+        {
+            return;
+        }
+        char line[logging::Line::capacity + 1];
+        auto size = snprintf(line, sizeof line, "[%05" PRIu64 "] %.*s",
+            static_cast<uint64_t>(id), static_cast<int>(message.size()), message.data());
+        logging::write({ line, std::min(static_cast<size_t>(std::max(size, 0)), sizeof line - 1) });
+    }
+
+    static string const outputPath;
+private:
+    ID const id;
+    int const endpoint;
+    float const delay;
+    election::Discovery const discovery;
+    shared_ptr<thread> processThread;
+    // listen -> process has exactly one producer and one consumer,
+    // it is only allocated by start() so that nodes driven by a runtime::Pool stay small
+    // stamped when pushed, to measure the time spent in the queue
+    struct Queued
+    {
+        Message message;
+        metrics::Clock::time_point at;
+    };
+    using MessageQueue = SpscQueue<Queued, 256>;
+    // a listen thread per neighbor the algorithm sends to, the sending is done by the wheel thread, or by the process thread over Qt
+    struct Link
+    {
+        bool used = false;
+        int endpoint = 0;
+        int neighborEndpoint = 0;
+        shared_ptr<thread> listenThread;
+        shared_ptr<MessageQueue> receiveQueue;
+        shared_ptr<transport::Receiver> receiver;
+        shared_ptr<transport::Sender> sender;
+        bool connected = false; // set by the process thread before anything is scheduled
+        vector<Message> batch;  // wheel thread only, or the process thread of a node off the wheel
+    };
+    array<Link, 2> links; // indexed by side
+    shared_ptr<Doorbell> doorbell;
+    Wheel* wheel = nullptr; // none when the process thread releases the messages itself
+    deque<Outgoing> held;   // process thread only, when off the wheel, in the order they are due since the delay is per node
+    Startup* startup = nullptr;
+    election::Machine election;
+    // shared so that nodes stay movable, set once the leader is known
+    shared_ptr<atomic<bool>> finished = make_shared<atomic<bool>>(false);
+    Latch* decisions = nullptr;
+    // shared so that nodes stay movable, read by snapshots while the threads run
+    shared_ptr<metrics::NodeMetrics> stats = make_shared<metrics::NodeMetrics>();
+    enum struct Direction { Receive, Send };
+
+    template <typename Send>
+    auto counted(Send& send)
+    {
+        return [this, &send] (Message const& msg, election::Side side)
+        {
+            if (trace::enabled())
+            {
+                trace::record(trace::messageEvent(trace::Kind::Send, endpoint, msg, side));
+            }
+            stats->countSent(msg);
+            if (links[0].sender == nullptr)
+            {
+                // the wheel thread counts what the transports carry
+                stats->count(stats->bytesSent, wire::frameSize(msg));
+            }
+            send(msg, side);
+        };
+    }
+
+    // the node index of the trace is the endpoint, both are numbered like the nodes
+    void enter()
+    {
+        stats->enter(election.getState());
+        if (trace::enabled())
+        {
+            trace::record(trace::stateEvent(endpoint, election.getState()));
+        }
+    }
+
+    static size_t index(election::Side side) { return side == election::Side::Clockwise ? 0 : 1; }
+    static election::Side side(size_t index) { return index == 0 ? election::Side::Clockwise : election::Side::CounterClockwise; }
+
+    // the threads block on their queue or socket and are woken as soon as there is work,
+    // the listen threads end when their neighbor disconnects, this period only bounds a single receive call
+    static auto constexpr idlePeriod = 1s;
+
+    void printMessage(Message const& msg, Direction direction, string const& action)
+    {
+        if (msg.type == Message::Type::Greetings || logging::enabled(logging::Level::Debug) == false)
+        {
+            return;
+        }
+
+        ostringstream s;
+        if (direction == Direction::Receive)
+        {
+            s << "received ";
+        }
+        else if (direction == Direction::Send)
+        {
+            s << "sending ";
+        }
+        s << json::describe(msg.type) << " from " <<
+            std::setfill('0') << std::setw(5) <<
+            to_string(msg.id);
+        if (msg.type == Message::Type::Probe || msg.type == Message::Type::Reply)
+        {
+            s << " phase " << unsigned{msg.phase} << " hops " << msg.hops;
+        }
+        if (action.length())
+        {
+            s << ", " << action;
+        }
+        print(logging::Level::Debug, s.str());
+    }
+
+    void listen(Link& link)
+    {
+        auto& receiver = link.receiver;
+        try
+        {
+            receiver->open();
+        }
+        catch (std::exception const& e)
+        {
+            throw std::runtime_error(to_string(id) + " listen thread " + e.what());
+        }
+        print(logging::Level::Info, "listening on " + receiver->describe());
+        startup->listening.countDown();
+
+        // the sender is connected by now, so the connection is already waiting
+        startup->waitConnected();
+        try
+        {
+            receiver->accept();
+        }
+        catch (std::exception const& e)
+        {
+            throw std::runtime_error(to_string(id) + " listenThread " + e.what());
+        }
+
+        // once the node decided, the process thread is gone and what still arrives is dropped
+        while (receiver->receive(idlePeriod, [this, &link] (Message const& msg)
+            {
+                stats->queues->receiveQueueDepth.record(link.receiveQueue->size());
+                auto const queued = Queued{ msg, metrics::Clock::now() };
+                while (getFinished() == false && link.receiveQueue->tryPush(queued) == false)
+                {
+                    std::this_thread::yield();
+                }
+            }))
+        {
+        }
+        print(logging::Level::Info, "end listen thread");
+    }
+
+    // on the thread that releases the messages, every batch leaves in one write
+    void flush(Link& link)
+    {
+        auto const bytesBefore = link.sender->getBytesSent();
+        link.sender->send(link.batch.data(), link.batch.size());
+        stats->count(stats->bytesSent, link.sender->getBytesSent() - bytesBefore);
+        link.batch.clear();
+    }
+
+    void process()
+    {
+        // the link delay is applied to each message on its own instead of stopping the link:
+        // the wheel holds it until it is due, while the ones sent after it are already on their way
+        auto const linkDelay = chrono::duration_cast<metrics::Clock::duration>(chrono::duration<float>{delay});
+        auto send = [this, linkDelay] (Message const& msg, election::Side side)
+        {
+            auto const pending = stats->queues->pending.fetch_add(1, memory_order_relaxed);
+            stats->queues->inFlight.record(pending);
+            if (logging::enabled(logging::Level::Debug))
+            {
+                printMessage(msg, Direction::Send, "in flight: " + to_string(pending));
+            }
+            auto const now = metrics::Clock::now();
+            if (wheel)
+            {
+                wheel->schedule(now + linkDelay, { this, index(side), msg, now });
+            }
+            else
+            {
+                held.push_back({ this, index(side), msg, now });
+            }
+        };
+        // off the wheel, releases the held messages that are due and returns how long until the next one
+        vector<Outgoing> due;
+        auto releaseHeld = [this, linkDelay, &due] () -> optional<chrono::milliseconds>
+        {
+            auto const now = metrics::Clock::now();
+            due.clear();
+            while (held.empty() == false && held.front().scheduled + linkDelay <= now)
+            {
+                due.push_back(held.front());
+                held.pop_front();
+            }
+            if (due.empty() == false)
+            {
+                release(due);
+            }
+            if (held.empty())
+            {
+                return {};
+            }
+            return chrono::ceil<chrono::milliseconds>(held.front().scheduled + linkDelay - now);
+        };
+
+        for (auto& link: links)
+        {
+            if (link.used)
+            {
+                link.listenThread = std::make_shared<thread>(&Node::listen, this, std::ref(link));
+            }
+        }
+        startup->waitListening();
+        for (auto& link: links)
+        {
+            if (link.used)
+            {
+                print(logging::Level::Info, "talking on " + link.sender->describe());
+                try
+                {
+                    link.sender->connect();
+                }
+                catch (std::exception const& e)
+                {
+                    throw std::runtime_error(to_string(id) + " talk " + e.what());
+                }
+                link.connected = true;
+                startup->connected.countDown();
+            }
+        }
+        startup->waitConnected();
+
+        beginReady(send);
+        auto pending = [this]
+        {
+            return std::any_of(links.begin(), links.end(), [] (Link const& link) {
+                return link.used && link.receiveQueue->size() > 0; });
+        };
+        while (election.getFinished() == false)
+        {
+            if (auto const next = releaseHeld())
+            {
+                doorbell->wait(*next, pending);
+                releaseHeld();
+            }
+            else
+            {
+                doorbell->wait(pending);
+            }
+            for (size_t i=0; i<links.size() && election.getFinished() == false; ++i)
+            {
+                if (links[i].used == false)
+                {
+                    continue;
+                }
+                // the clockwise link listens to the counter-clockwise neighbor and the other way around
+                auto const from = election::opposite(side(i));
+                while (auto queued = links[i].receiveQueue->pop())
+                {
+                    stats->queues->receiveQueueWait.record(metrics::microseconds(metrics::Clock::now() - queued->at));
+                    receive(queued->message, from, send);
+                    if (election.getFinished())
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+        if (wheel == nullptr)
+        {
+            // what the node still holds leaves before its sockets close, on the thread that made them
+            while (auto const next = releaseHeld())
+            {
+                std::this_thread::sleep_for(*next);
+            }
+            for (auto& link: links)
+            {
+                if (link.connected)
+                {
+                    link.sender->disconnect();
+                    link.connected = false;
+                }
+            }
+        }
+    }
+};
+string const Node::outputPath = "output.log";
+
+// the nodes are built while the input is read, with the IDs of the input when it has some
+auto loadNodes(Options const& options, uint64_t seed, bool& fixedIDs, vector<topology::Edge>& edges)
+{
+    vector<Node> nodes;
+    vector<Limits::IDType> ids;
+    input::read(options.inputPath,
+        [&] (size_t count, bool hasIDs)
+        {
+            std::cout << "Count: " << count << std::endl;
+            nodes.reserve(count);
+            fixedIDs = hasIDs;
+            if (hasIDs == false)
+            {
+                ids = generateIDs(count, options.ids, options.idBits, seed);
+            }
+        },
+        [&] (size_t i, float delay, optional<uint64_t> id)
+        {
+            nodes.emplace_back(id ? *id : ids[i], delay, options.algorithm, options.discovery);
+        },
+        [&] (size_t a, size_t b)
+        {
+            edges.emplace_back(a, b);
+        });
+    if (options.logLevel < logging::Level::Info)
+    {
+        return nodes;
+    }
+    for (size_t i=0; i<nodes.size(); ++i)
+    {
+        cout <<
+            std::setfill('0') << std::setw(5) <<
+            nodes[i].getID() << "\t";
+        if (i == 0)
+        {
+            cout << "↖";
+        }
+        else if (i == nodes.size() - 1)
+        {
+            cout << "↗";
+        }
+        else
+        {
+            cout << "↑";
+        }
+        cout << endl;
+        if (i != nodes.size() - 1)
+        {
+            cout << "↓" << endl;
+        }
+    }
+    return nodes;
+}
+
+// only needed for the clock IDs, the others are distinct by construction
+void verifyUniqueIDs(vector<Node> const& nodes)
+{
+    set<Limits::IDType> ids;
+    for (auto const& node: nodes)
+    {
+        auto id = node.getID();
+        if (ids.count(id))
+        {
+            throw std::runtime_error("This ID is not unique, assigned to multiple nodes: " + std::to_string(id));
+        }
+        ids.insert(id);
+    }
+}
+
+// link to neighbors, before the nodes are started wherever they run
+void linkNodes(vector<Node>& nodes, election::Algorithm algorithm)
+{
+    auto const count = static_cast<int>(nodes.size());
+    for (size_t i=0; i<nodes.size(); ++i)
     {
-        throw std::runtime_error(string{"Usage: "} + string{argv[0]} + string{" <input-file>"});
+        // std::cout << "index " << i << " neighbor " << (i + nodes.size() - 1) % nodes.size() << std::endl;
+        auto const& counterClockwiseNeighbor =
+            nodes.at((i + nodes.size() - 1) % nodes.size());
+        auto const& clockwiseNeighbor =
+            nodes.at((i + 1) % nodes.size());
+        nodes[i].link(election::Side::Clockwise, nodes[i].getEndpoint(), counterClockwiseNeighbor.getEndpoint());
+        if (election::bidirectional(algorithm))
+        {
+            // the links going the other way are numbered after all the clockwise ones
+            nodes[i].link(election::Side::CounterClockwise, count + nodes[i].getEndpoint(), count + clockwiseNeighbor.getEndpoint());
+        }
     }
-    auto inputPath = string{argv[1]};
-    return filesystem::path{inputPath};
 }
 
-auto parseInput(filesystem::path const& path)
+auto linkCount(size_t nodeCount, election::Algorithm algorithm)
+{
+    return nodeCount * (election::bidirectional(algorithm) ? 2 : 1);
+}
+
+// start processing, listening and talking
+void startNodes(vector<Node>& nodes, Options const& options, Node::Wheel& wheel, Node::Startup& startup,
+    filesystem::path const& logPath = Node::outputPath)
 {
-    auto handleInputError = [&path] (string const& message)
+    // truncates the log file
+    logging::start(logPath, options.logLevel, true);
+
+    if (options.runtime != Runtime::Pool)
     {
-        throw std::runtime_error("Error '" + message + "' for path '" + path.string() + "'");
-    };
+        for (auto& node: nodes)
+        {
+            node.start(options.transport, options.wire, wheel, startup);
+        }
+    }
+    for (auto const& node: nodes)
+    {
+        node.printDescription();
+    }
+}
+
+// set by SIGUSR1 to ask for a metrics snapshot while the election runs
+volatile sig_atomic_t snapshotRequested = 0;
 
-    if (filesystem::exists(path) == false)
+// every node, then their sum, written aside and renamed so that a reader never sees half a snapshot
+void writeMetrics(vector<Node> const& nodes, filesystem::path const& path)
+{
+    auto const now = metrics::Clock::now();
+    auto const partial = filesystem::path{path.string() + ".tmp"};
     {
-        handleInputError("Does not exist");
+        std::ofstream out{partial, ofstream::trunc};
+        if (out.good() == false)
+        {
+            throw std::runtime_error("Failed to open the metrics file " + partial.string());
+        }
+        metrics::NodeMetrics total;
+        out << "{\n  \"nodes\": [";
+        for (size_t i=0; i<nodes.size(); ++i)
+        {
+            out << (i ? ",\n" : "\n") << "    {\n      \"id\": " << nodes[i].getID() << ",\n";
+            metrics::writeJson(out, nodes[i].getMetrics(), now, "      ");
+            out << "\n    }";
+            total.add(nodes[i].getMetrics(), now);
+        }
+        out << "\n  ],\n  \"total\": {\n";
+        metrics::writeJson(out, total, now, "    ");
+        out << "\n  }\n}\n";
     }
-    if (filesystem::is_directory(path))
+    filesystem::rename(partial, path);
+}
+
+// waits for the election to finish, then for the threads of the nodes
+// blocks until every node counted the latch down, only waking up to write the snapshots asked by SIGUSR1
+void waitForDecisions(vector<Node> const& nodes, Latch& decisions, filesystem::path const& metricsPath)
+{
+    if (metricsPath.empty())
     {
-        handleInputError("Is a directory");
+        decisions.wait();
+        return;
     }
-    if (filesystem::is_regular_file(path) == false)
+    while (decisions.waitFor(100ms) == false)
     {
-        handleInputError("Not a regular file");
+        if (snapshotRequested)
+        {
+            snapshotRequested = 0;
+            writeMetrics(nodes, metricsPath);
+        }
     }
+}
 
-    std::ifstream stream{path, ifstream::in};
-    if (stream.good() == false)
+// once every node decided: the wheel writes what it still holds, then the senders close,
+// so that each listen thread sees the end of its stream and every thread ends on its own
+void shutDown(vector<Node>& nodes, Node::Wheel& wheel, filesystem::path const& metricsPath)
+{
+    wheel.drain();
+    for (auto& node: nodes)
+    {
+        node.disconnect();
+    }
+    for (auto& node: nodes)
+    {
+        node.join();
+    }
+    wheel.stop();
+    if (metricsPath.empty() == false)
+    {
+        writeMetrics(nodes, metricsPath);
+    }
+}
+
+// the header of a trace names every node of the ring, even those another process runs
+void startTrace(vector<Node> const& ring, Options const& options, filesystem::path const& path)
+{
+    vector<election::ID> ids;
+    ids.reserve(ring.size());
+    for (auto const& node: ring)
+    {
+        ids.emplace_back(node.getID());
+    }
+    trace::start(path, options.algorithm, options.discovery, ids);
+}
+
+// once the threads of the nodes ended
+void stopTrace()
+{
+    if (auto const dropped = trace::stop())
+    {
+        std::cerr << dropped << " events dropped from the trace, the file was full" << std::endl;
+    }
+}
+
+// what is left of a node once the election is over, small enough to be sent to another process
+struct Outcome
+{
+    Limits::IDType id;
+    optional<Limits::IDType> leader;
+    uint64_t messages;
+    uint64_t bytes;
+};
+
+auto outcomes(vector<Node> const& nodes)
+{
+    vector<Outcome> ret;
+    ret.reserve(nodes.size());
+    for (auto const& node: nodes)
+    {
+        ret.push_back({ node.getID(), node.getLeader(), node.getMessagesSent(), node.getBytesSent() });
+    }
+    return ret;
+}
+
+void checkConsensus(vector<Outcome> const& outcomes)
+{
+    auto leader = outcomes.front().leader;
+    if (std::any_of(outcomes.begin(), outcomes.end(), [&leader, &outcomes] (Outcome const& outcome) {
+        if (!outcome.leader)
+        {
+            cout << "Leader: none for id " << outcome.id << endl;
+            return true;
+        }
+        if (outcome.leader != leader)
+        {
+            cout << "Leaders differ: " << to_string(*outcome.leader) << " for " << to_string(outcome.id) <<
+                " and " << (leader ? to_string(*leader) : "none") << " for " << to_string(outcomes.front().id) <<
+                endl;
+            return true;
+        }
+        return false; }))
     {
-        handleInputError("Failed to open");
+        throw std::runtime_error("No consensus");
     }
-    string line;
-    if (!getline(stream, line))
+}
+
+// one line of the benchmark report
+struct Measurement
+{
+    size_t nodes = 0;
+    double wallTime = 0;     // seconds from the start of the nodes until their threads ended
+    double electionTime = 0; // virtual seconds in a simulation, seconds until the last node decided otherwise
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    size_t failovers = 0;
+    double detectionTime = 0; // mean virtual seconds, over the failovers
+    double recoveryTime = 0;
+};
+
+auto measure(vector<Outcome> const& outcomes, double wallTime, double electionTime)
+{
+    Measurement ret;
+    ret.nodes = outcomes.size();
+    ret.wallTime = wallTime;
+    ret.electionTime = electionTime;
+    for (auto const& outcome: outcomes)
     {
-        handleInputError("Failed to read first line");
+        ret.messages += outcome.messages;
+        ret.bytes += outcome.bytes;
     }
-    int count = 0;
-    try
+    return ret;
+}
+
+// appends a line to the CSV file, with a header when the file is new
+void writeReport(Options const& options, Measurement const& measurement)
+{
+    auto const newFile = filesystem::exists(options.reportPath) == false || filesystem::file_size(options.reportPath) == 0;
+    std::ofstream stream{options.reportPath, ofstream::app};
+    if (stream.good() == false)
     {
-        count = stoi(line);
+        throw std::runtime_error("Failed to open the report " + options.reportPath.string());
     }
-    catch (std::exception const&)
+    rusage usage{};
+    // the largest of the processes of the ring, without the coordinator
+    getrusage(options.runtime == Runtime::Processes ? RUSAGE_CHILDREN : RUSAGE_SELF, &usage);
+
+    auto const runtime =
+        options.runtime == Runtime::Threads ? "threads" :
+        options.runtime == Runtime::Pool ? "pool" :
+        options.runtime == Runtime::Processes ? "processes" : "simulation";
+    auto const algorithm =
+        options.algorithm == election::Algorithm::ChangRoberts ? "chang-roberts" :
+        options.algorithm == election::Algorithm::HirschbergSinclair ? "hirschberg-sinclair" : "echo";
+    auto const transport =
+        options.runtime != Runtime::Threads && options.runtime != Runtime::Processes ? "none" :
+        options.transport == transport::Kind::Tcp ? "tcp" :
+        options.transport == transport::Kind::InProcess ? "inprocess" :
+        options.transport == transport::Kind::Unix ? "unix" : "socketpair";
+    auto const wire = options.wire == wire::Format::Binary ? "binary" : "text";
+    auto const ids =
+        options.ids == IDOrder::Clock ? "clock" :
+        options.ids == IDOrder::Random ? "random" :
+        options.ids == IDOrder::Ascending ? "ascending" : "descending";
+
+    if (newFile)
     {
-        handleInputError("Failed to parse count at line 1: " + line);
+        stream << "label,input,runtime,algorithm,transport,wire,ids,nodes,"
+            "wall_seconds,election_seconds,messages,messages_per_node,bytes,peak_rss_kb,"
+            "failovers,detection_seconds,recovery_seconds\n";
     }
-    if (count < Limits::LowerBound || count > Limits::UpperBound)
+    stream << options.label << ',' << options.inputPath.filename().string() << ',' <<
+        runtime << ',' << algorithm << ',' << transport << ',' << wire << ',' << ids << ',' <<
+        measurement.nodes << ',' <<
+        measurement.wallTime << ',' << measurement.electionTime << ',' <<
+        measurement.messages << ',' << static_cast<double>(measurement.messages) / measurement.nodes << ',' <<
+        measurement.bytes << ',' << usage.ru_maxrss << ',' <<
+        measurement.failovers << ',' << measurement.detectionTime << ',' << measurement.recoveryTime << '\n';
+}
+
+// nothing for the ring of the command line, which every runtime knows how to wire
+optional<topology::Graph> buildGraph(size_t count, Options const& options, vector<topology::Edge> edges, uint64_t seed)
+{
+    auto spec = options.topology;
+    if (edges.empty() == false)
     {
-        handleInputError("Count does not fit in an unsigned 16-bit integer: " + std::to_string(count));
+        if (spec.kind != topology::Kind::Ring)
+        {
+            throw std::runtime_error("The input has its own edges, they cannot be mixed with --topology");
+        }
+        checkGraphOptions(options);
+        spec.kind = topology::Kind::Edges;
     }
-    std::cout << "Count: " << count << std::endl;
-    if (count == 0)
+    if (spec.kind == topology::Kind::Ring)
     {
-        handleInputError("No election with zero voter");
+        return nullopt;
     }
+    auto graph = topology::build(spec, count, std::move(edges), seed);
+    std::cout << "Graph of " << graph.size() << " nodes and " << graph.getEdgeCount() << " edges, " <<
+        graph.eccentricity(0) << " hops at most from node 0" << std::endl;
+    return graph;
+}
+
+auto simulate(vector<Node> const& nodes, Options const& options, topology::Graph const* graph)
+{
+    vector<Limits::IDType> ids;
     vector<float> delays;
-    for (int i=0; i<count; ++i)
+    for (auto const& node: nodes)
+    {
+        ids.emplace_back(node.getID());
+        delays.emplace_back(node.getDelay());
+    }
+    auto wallStart = std::chrono::steady_clock::now();
+    simulation::Result result;
+    if (options.hierarchy)
+    {
+        auto const hierarchy = simulation::runHierarchy(ids, delays, options.algorithm, options.discovery, *options.hierarchy, options.workers);
+        cout << hierarchy.groups << " sub-rings elected in " << hierarchy.lowerTime << " s with " << hierarchy.lowerMessages << " messages, " <<
+            "their leaders in " << hierarchy.upperTime << " s with " << hierarchy.upperMessages << " messages, " <<
+            "announced in " << hierarchy.downTime << " s" << endl;
+        result = hierarchy.result;
+    }
+    else
+    {
+        result = graph ?
+            simulation::runGraph(*graph, ids, delays) :
+            simulation::run(ids, delays, options.algorithm, options.discovery, options.crashes);
+    }
+    auto wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    optional<Limits::IDType> leader;
+    for (size_t i=0; i<nodes.size(); ++i)
     {
-        if (!getline(stream, line))
+        if (result.crashed[i])
         {
-            handleInputError("Failed to read the delay of node with index " + std::to_string(i) + " expected at line " + std::to_string(i+2));
+            continue;
         }
-        float delay = 0;
-        try
+        if (!leader)
         {
-            delay = std::stof(line);
+            leader = result.leaders[i];
         }
-        catch (std::exception const&)
+        if (!result.leaders[i] || result.leaders[i] != leader)
         {
-            handleInputError("Failed to parse a floating-point number at line " + std::to_string(i+2));
+            throw std::runtime_error("No consensus for id " + to_string(nodes[i].getID()));
         }
-        delays.emplace_back(delay);
-        // std::cout << "Delay " << i << " delay " << delay << std::endl;
     }
-    return delays;
+    // the first leader crashed when there are failovers
+    cout << "Simulated leader " << (result.failovers.empty() ? *leader : result.failovers.front().leader) <<
+        " elected after " << result.electionTime << " s with " << result.messages << " messages" <<
+        " (simulated in " << wallTime << " s)" << endl;
+
+    // virtual microseconds, like the latencies of the threads runtime
+    metrics::Histogram detection;
+    metrics::Histogram recovery;
+    for (auto const& failover: result.failovers)
+    {
+        cout << "Leader " << failover.leader << " crashed: suspected after " << failover.detection <<
+            " s, next leader agreed after " << failover.recovery << " s with " << failover.messages << " messages" << endl;
+        detection.record(static_cast<uint64_t>(failover.detection * 1e6));
+        recovery.record(static_cast<uint64_t>(failover.recovery * 1e6));
+    }
+    if (result.failovers.empty() == false)
+    {
+        cout << "Detection us ";
+        metrics::writeJson(cout, detection);
+        cout << endl << "Recovery us ";
+        metrics::writeJson(cout, recovery);
+        cout << endl << "Last leader " << *leader << ", " << result.heartbeats << " heartbeats" << endl;
+    }
+
+    Measurement ret;
+    ret.nodes = nodes.size();
+    ret.wallTime = wallTime;
+    ret.electionTime = result.electionTime;
+    ret.messages = result.messages;
+    ret.bytes = result.bytes;
+    ret.failovers = result.failovers.size();
+    ret.detectionTime = detection.getMean() / 1e6;
+    ret.recoveryTime = recovery.getMean() / 1e6;
+    return ret;
 }
 
-class Node
+// text or binary input to binary input, with the IDs generated as for a run when asked to
+void convertInput(Options const& options, uint64_t seed)
 {
-private:
-    using ID = Limits::IDType;
+    vector<float> delays;
+    vector<Limits::IDType> ids;
+    input::read(options.inputPath,
+        [&] (size_t count, bool hasIDs)
+        {
+            delays.reserve(count);
+            if (options.convertIDs)
+            {
+                ids = hasIDs ? vector<Limits::IDType>{} : generateIDs(count, options.ids, options.idBits, seed);
+                ids.reserve(count);
+            }
+        },
+        [&] (size_t, float delay, optional<uint64_t> id)
+        {
+            delays.push_back(delay);
+            if (id && options.convertIDs)
+            {
+                ids.push_back(*id);
+            }
+        },
+        [] (size_t, size_t)
+        {
+            throw std::runtime_error("The binary format has no edges");
+        });
+    input::writeBinary(options.convertPath, delays, ids);
+    std::cout << "Converted " << delays.size() << " nodes" << (ids.empty() ? "" : " with their IDs") <<
+        " to " << options.convertPath.string() << std::endl;
+}
 
-    static auto generateID()
+// the per process file of a shard, output.log becomes output.3.log
+filesystem::path shardPath(filesystem::path const& path, size_t shard)
+{
+    if (path.empty())
     {
-        /* random number : no guarantee on uniqueness
-        static std::mt19937 random_generator = [] () {
-            auto ret = std::mt19937 { std::random_device{}() };
-            ret.seed(time(0));
-            return ret;
-        }();
+        return path;
+    }
+    return path.parent_path() / (path.stem().string() + "." + std::to_string(shard) + path.extension().string());
+}
 
-        std::uniform_int_distribution<ID> distrib { Limits::LowerBound, Limits::UpperBound };
-        return distrib(random_generator);
-        */
+// both return false when the other process is gone
+bool writeAll(int fd, void const* data, size_t size)
+{
+    auto bytes = static_cast<char const*>(data);
+    while (size)
+    {
+        auto const written = ::write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t size)
+{
+    auto bytes = static_cast<char*>(data);
+    while (size)
+    {
+        auto const got = ::read(fd, bytes, size);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return false;
+        }
+        bytes += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// an Outcome on the socket of a shard, both ends are the same executable
+struct OutcomeRecord
+{
+    uint64_t id;
+    uint64_t leader;
+    uint64_t messages;
+    uint64_t bytes;
+    uint8_t hasLeader;
+};
 
-        static std::chrono::_V2::high_resolution_clock clock;
-        auto ticks = clock.now().time_since_epoch().count();
-        ticks *= ticks; // so that it's not so neatly ordered
-        ticks %= Limits::UpperBound;
-        // std::cout << "clock " << ticks << std::endl;
-        return ticks;
+// in the forked process of a shard: runs its nodes like the threads runtime,
+// passes the startup gates with the coordinator, and sends it the outcome of each node
+void runShard(vector<Node>& ring, Options options, size_t shard, size_t begin, size_t end, int coordinator)
+{
+    if (options.tracePath.empty() == false)
+    {
+        startTrace(ring, options, shardPath(options.tracePath, shard));
     }
-    static auto generatePort()
+    vector<Node> nodes{make_move_iterator(ring.begin() + begin), make_move_iterator(ring.begin() + end)};
+    ring.clear();
+    auto gate = [coordinator] (char step)
+    {
+        if (writeAll(coordinator, &step, 1) == false || readAll(coordinator, &step, 1) == false)
+        {
+            throw std::runtime_error("Lost the coordinator at startup step " + string(1, step));
+        }
+    };
+    options.metricsPath = shardPath(options.metricsPath, shard);
+    Node::Wheel wheel{&Node::release};
+    wheel.start();
+    Node::Startup startup{linkCount(nodes.size(), options.algorithm), gate};
+    Latch decisions{nodes.size()};
+    for (auto& node: nodes)
     {
-        static int start = 1025;
-        return start++;
+        node.reportDecision(decisions);
     }
-public:
-    Node(float delay) :
-        id(generateID()),
-        port(generatePort()),
-        delay(delay)
+    startNodes(nodes, options, wheel, startup, shardPath(Node::outputPath, shard));
+    waitForDecisions(nodes, decisions, options.metricsPath);
+    auto const decided = 'D';
+    if (writeAll(coordinator, &decided, 1) == false)
     {
+        throw std::runtime_error("Lost the coordinator once decided");
     }
-    void linkAndStart(int neighborPort)
+    // a node is finished as soon as it forwards the leader, the neighbors of other shards still have to get it
+    shutDown(nodes, wheel, options.metricsPath);
+    stopTrace();
+    logging::stop();
+    for (auto const& outcome: outcomes(nodes))
     {
-        this->neighborPort = neighborPort;
-        processThread = std::make_shared<thread>(&Node::process, this);
+        auto record = OutcomeRecord{ outcome.id, outcome.leader.value_or(0), outcome.messages, outcome.bytes, outcome.leader.has_value() };
+        if (writeAll(coordinator, &record, sizeof record) == false)
+        {
+            throw std::runtime_error("Lost the coordinator while sending the outcomes");
+        }
     }
-    void printDescription() const
+}
+
+// the coordinator of the processes runtime: forks a process per shard of consecutive nodes,
+// opens the startup gates once every shard reached them, and checks the consensus on the outcomes they send back
+// the shards share nothing but their sockets, so a message between two shards pays a real cross-process hop
+Measurement launch(vector<Node>& nodes, Options const& options)
+{
+    if (options.transport != transport::Kind::Tcp && options.transport != transport::Kind::Unix)
     {
-        ostringstream s;
-        s << "Starting to talk to port " << port <<  " and to listen to " << neighborPort <<  " with delay " << delay;
-        PrintSafely(s.str());
+        throw std::runtime_error("The processes runtime needs --transport tcp or unix");
     }
-    auto getPort() const { return port; }
-    auto getID() const { return id; }
-    auto getFinished() const { return finished; }
-    auto getLeader() const { return leader; }
-    void join()
+    if (options.transport == transport::Kind::Unix)
     {
-        processThread->join();
-        talkThread->join();
-        listenThread->join();
+        transport::Native::shareDirectory();
     }
+    auto const shardCount = std::min(nodes.size(), options.processes ? options.processes : nodes.size());
+    linkNodes(nodes, options.algorithm);
 
-    void PrintSafely(string const& message) const
+    struct Shard
     {
-        lock_guard<mutex> guard{printLock};
-        ostringstream s;
-        s <<
-            "[" <<
-            std::setfill('0') << std::setw(5) <<
-            to_string(id) <<
-            "] " << message << std::endl;
-        cout << s.str();
-        try
+        pid_t pid;
+        int fd;
+        size_t count;
+    };
+    vector<Shard> shards;
+    // what is buffered would be written once by each process
+    std::cout.flush();
+    std::cerr.flush();
+    auto wallStart = std::chrono::steady_clock::now();
+    for (size_t s=0; s<shardCount; ++s)
+    {
+        auto const begin = nodes.size() * s / shardCount;
+        auto const end = nodes.size() * (s + 1) / shardCount;
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        {
+            throw std::runtime_error("Failed to create the socket of shard " + std::to_string(s) + ": " + strerror(errno));
+        }
+        auto const pid = ::fork();
+        if (pid < 0)
+        {
+            throw std::runtime_error("Failed to fork shard " + std::to_string(s) + ": " + strerror(errno));
+        }
+        if (pid == 0)
         {
-            // in production code, I would have a lock for each of the sinks: cout and the file
-            // for fewer lock contention
-            ofstream log{outputPath, ios_base::app};
-            log << s.str();
+            ::close(fds[0]);
+            for (auto const& shard: shards)
+            {
+                ::close(shard.fd);
+            }
+            auto status = 0;
+            try
+            {
+                runShard(nodes, options, s, begin, end, fds[1]);
+            }
+            catch (std::exception const& e)
+            {
+                std::cerr << "Shard " << s << ": " << e.what() << std::endl;
+                status = 1;
+            }
+            std::cout.flush();
+            // neither the static destructors nor the atexit handlers of the coordinator
+            ::_exit(status);
         }
-        catch (std::exception const&) { }
+        ::close(fds[1]);
+        shards.push_back({ pid, fds[0], end - begin });
     }
 
-    static string const outputPath;
-private:
-    ID const id;
-    int const port;
-    float const delay;
-    int neighborPort = 0;
-    shared_ptr<thread> processThread;
-    shared_ptr<thread> talkThread;
-    shared_ptr<thread> listenThread;
-    struct MessageQueue
+    auto pass = [&shards] (char step)
     {
-        queue<Message> messages;
-        shared_ptr<mutex> lock = make_shared<mutex>();
-        void push(Message const& msg)
-        {
-            lock_guard<mutex> guard{*lock};
-            messages.push(msg);
-        }
-        optional<Message> pop()
+        for (auto const& shard: shards)
         {
-            lock_guard<mutex> guard{*lock};
-            if (messages.empty())
+            char reached = 0;
+            if (readAll(shard.fd, &reached, 1) == false || reached != step)
             {
-                return {};
+                throw std::runtime_error("Shard process " + std::to_string(shard.pid) + " failed before startup step " + string(1, step));
             }
-            auto msg = messages.front();
-            messages.pop();
-            return msg;
         }
-        auto size()
+        for (auto const& shard: shards)
         {
-            lock_guard<mutex> guard{*lock};
-            return messages.size();
+            writeAll(shard.fd, &step, 1);
         }
     };
-    MessageQueue sendQueue;
-    MessageQueue receiveQueue;
-    shared_ptr<QTcpSocket> talkSocket;
-    shared_ptr<QTcpServer> listenServer;
-    QHostAddress const localhost = QHostAddress::LocalHost;
-    set<ID> peers;
-    optional<ID> leader;
-    bool finished = false;
-    enum struct Direction { Receive, Send };
-    int const dataStreamVersion = QDataStream::Qt_5_10;
-    static mutex printLock;
+    pass('L');
+    pass('C');
+    // every shard tells as soon as its nodes decided, before shutting down
+    for (auto const& shard: shards)
+    {
+        char decided = 0;
+        if (readAll(shard.fd, &decided, 1) == false || decided != 'D')
+        {
+            throw std::runtime_error("Shard process " + std::to_string(shard.pid) + " failed before deciding");
+        }
+    }
+    auto electionTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
 
-    void sleep() { std::this_thread::sleep_for(200ms); }
+    vector<Outcome> outcomes;
+    outcomes.reserve(nodes.size());
+    for (auto const& shard: shards)
+    {
+        for (size_t i=0; i<shard.count; ++i)
+        {
+            OutcomeRecord record;
+            if (readAll(shard.fd, &record, sizeof record) == false)
+            {
+                throw std::runtime_error("Shard process " + std::to_string(shard.pid) + " failed before sending its outcomes");
+            }
+            outcomes.push_back({ record.id, record.hasLeader ? optional<Limits::IDType>{record.leader} : nullopt, record.messages, record.bytes });
+        }
+    }
+    auto wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    for (auto const& shard: shards)
+    {
+        int status = 0;
+        ::waitpid(shard.pid, &status, 0);
+        ::close(shard.fd);
+        if (WIFEXITED(status) == false || WEXITSTATUS(status) != 0)
+        {
+            throw std::runtime_error("Shard process " + std::to_string(shard.pid) + " failed");
+        }
+    }
+    checkConsensus(outcomes);
+    std::cout << "Consensus of " << outcomes.size() << " nodes in " << shards.size() << " processes on " << *outcomes.front().leader << std::endl;
+    return measure(outcomes, wallTime, electionTime);
+}
 
-    void printMessage(Message const& msg, Direction direction, string const& action)
+bool unitTestJson()
+{
+    auto ret = true;
+    vector<json::Message::Type> types =
+        {
+            json::Message::Type::Greetings,
+            json::Message::Type::ElectionStart,
+            json::Message::Type::ElectedLeader
+        };
+    for (auto type: types)
     {
-        if (msg.type == Message::Type::Greetings)
+        json::Message m = { 5584, type, "iorjjkgfd" };
+        auto s = json::to_string(m);
+        cout << endl << s << endl;
+        auto m2 = json::from_string(s);
+        cout << endl << (m2 ? "parsed" : "empty") << endl;
+        ret = ret && m2;
+        if (m2)
         {
-            return;
+            cout << endl << json::to_string(*m2) << endl;
         }
+    }
+
+    vector<pair<string, json::ParseError>> documents =
+        {
+            { "{\n\t\"source\": 5584,\n\t\"type\": 1,\n\t\"value\": something\n}", json::ParseError::None },
+            { " { \"value\" : \"a \\\"b\\\"\", \"type\":2 , \"source\":65535 } ", json::ParseError::None },
+            { "{\"source\": 18446744073709551615, \"type\": 0}", json::ParseError::None },
+            { "{\"source\": 18446744073709551616, \"type\": 0}", json::ParseError::BadNumber },
+            { "{\"source\": 1, \"type\": 6}", json::ParseError::BadType },
+            { "{\"source\": 1, \"source\": 2, \"type\": 0}", json::ParseError::DuplicateKey },
+            { "{\"source\": 1}", json::ParseError::MissingKey },
+            { "{\"source\": 1 \"type\": 0}", json::ParseError::ExpectedComma },
+            { "{\"source\": 1, \"type\": 0} x", json::ParseError::TrailingCharacters },
+            { "", json::ParseError::ExpectedObject },
+        };
+    for (auto const& [document, expected]: documents)
+    {
+        json::MessageView view;
+        auto error = json::parse(document, view);
+        cout << endl << document << endl <<
+            "-> " << json::describe(error) << (error == expected ? "" : " UNEXPECTED") << endl;
+        ret = ret && error == expected;
+    }
+    return ret;
+}
+
+bool unitTestWire()
+{
+    auto ret = true;
+    vector<json::Message> messages =
+        {
+            { 5584, json::Message::Type::Greetings, "" },
+            { 0xffff, json::Message::Type::ElectionStart, "something" },
+            { 0xfedcba9876543210, json::Message::Type::Probe, "", 7, 0x12345678, 3 },
+            { 0, json::Message::Type::ElectedLeader, "iorjjkgfd" },
+        };
+    vector<char> buffer(wire::maxFrameSize);
+    for (auto const& m: messages)
+    {
+        auto size = wire::encode(m, buffer.data(), buffer.size());
+        wire::FrameView frame;
+        size_t consumed = 0;
+        auto partial = wire::decode(buffer.data(), size - 1, frame, consumed);
+        auto status = wire::decode(buffer.data(), size, frame, consumed);
+        auto ok =
+            size == wire::headerSize + m.value.size() &&
+            partial == wire::Status::Incomplete &&
+            status == wire::Status::Ok &&
+            consumed == size &&
+            frame.id == m.id && frame.type == m.type && frame.value == m.value.view() &&
+            frame.phase == m.phase && frame.hops == m.hops && frame.epoch == m.epoch;
+        cout << json::to_string(m) << endl << (ok ? "round trip ok" : "round trip FAILED") << endl;
+        ret = ret && ok;
+    }
+    return ret;
+}
+
+bool unitTestSpsc()
+{
+    auto ret = true;
+    auto check = [&ret] (string const& what, bool ok)
+    {
+        cout << what << (ok ? " ok" : " FAILED") << endl;
+        ret = ret && ok;
+    };
 
-        ostringstream s;
-        if (direction == Direction::Receive)
-        {
-            s << "received ";
-        }
-        else if (direction == Direction::Send)
-        {
-            s << "sending ";
-        }
-        if (msg.type == Message::Type::Greetings)
+    SpscQueue<int, 4> queue;
+    check("spsc empty", !queue.pop() && queue.size() == 0);
+    auto pushed = true;
+    for (auto i=0; i<4; ++i)
+    {
+        pushed = pushed && queue.tryPush(i);
+    }
+    check("spsc full", pushed && queue.tryPush(4) == false && queue.size() == 4);
+    auto first = queue.pop();
+    auto second = queue.pop();
+    check("spsc room after pops", first == 0 && second == 1 && queue.tryPush(4) && queue.tryPush(5) && queue.tryPush(6) == false);
+    // the indices keep growing past the capacity while the slots wrap around
+    auto ordered = true;
+    auto expected = 2;
+    auto next = 6;
+    for (auto round=0; round<10; ++round)
+    {
+        for (auto i=0; i<3; ++i)
         {
-            s << "Greetings";
+            ordered = ordered && queue.pop() == expected++;
         }
-        else if (msg.type == Message::Type::ElectionStart)
+        for (auto i=0; i<3; ++i)
         {
-            s << "ElectionStart";
+            ordered = ordered && queue.tryPush(next++);
         }
-        else if (msg.type == Message::Type::ElectedLeader)
+    }
+    while (auto item = queue.pop())
+    {
+        ordered = ordered && *item == expected++;
+    }
+    check("spsc wrap around", ordered && expected == next && queue.size() == 0);
+
+    // one producer thread and one consumer blocked on the doorbell, every item once and in order
+    auto constexpr count = 100000;
+    SpscQueue<int, 64> shared;
+    thread producer{[&shared] {
+        for (auto i=0; i<count; ++i)
         {
-            s << "ElectedLeader";
+            shared.push(i);
         }
-        s << " from " <<
-            std::setfill('0') << std::setw(5) <<
-            to_string(msg.id);
-        if (action.length())
+    }};
+    auto inOrder = true;
+    for (auto i=0; i<count; )
+    {
+        if (auto item = shared.waitPop(1s))
         {
-            s << ", " << action;
+            inOrder = inOrder && *item == i++;
         }
-        PrintSafely(s.str());
     }
+    producer.join();
+    check("spsc two threads", inOrder && !shared.pop());
+    return ret;
+}
 
-    void listen()
+bool unitTestTimerWheel()
+{
+    auto ret = true;
+    auto check = [&ret] (string const& what, bool ok)
     {
-        listenServer = make_shared<QTcpServer>();
-        if (listenServer->listen(localhost, neighborPort) == false)
-        {
-            throw std::runtime_error(to_string(id) + " listen thread Failed to listen on port " + to_string(neighborPort));
-        }
-        PrintSafely("listening on port " + to_string(neighborPort));
+        cout << what << (ok ? " ok" : " FAILED") << endl;
+        ret = ret && ok;
+    };
 
-        listenServer->waitForNewConnection(3000);
-        auto socket = listenServer->nextPendingConnection();
-        if (socket == nullptr)
+    // a 10 us tick puts level 1 past 2.56 ms and level 2 past 655 ms, so a second covers three levels
+    using Clock = timing::TimerWheel<int>::Clock;
+    auto constexpr tick = chrono::microseconds{10};
+    struct Released
+    {
+        int item;
+        Clock::time_point at;
+    };
+    mutex lock;
+    vector<Released> released;
+    timing::TimerWheel<int> wheel{[&] (vector<int>& items) {
+        auto const now = Clock::now();
+        lock_guard<mutex> guard{lock};
+        for (auto item: items)
         {
-            throw std::runtime_error(to_string(id) +  " listenThread nobody connected before timeout");
+            released.push_back({ item, now });
         }
+    }, tick};
+    wheel.start();
 
-        while (finished == false)
+    // scheduled out of order, the item is its rank in the release order
+    auto const origin = Clock::now();
+    vector<pair<chrono::microseconds, int>> schedule =
         {
-            sleep();
-            ostringstream s;
-            s << "\tlisten\t\t";
-            // s << "state " << (int)socket->state();
-            QDataStream in(socket);
-            in.setVersion(dataStreamVersion);
-            QString msg;
-// #warning "do we need a loop and commitTransaction() ?"
-            do
-            {
-                if (socket->waitForReadyRead(1))
-                {
-                    in.startTransaction();
-                    in >> msg;
-                    s << " READ '";
-                    s << msg.toStdString() << "'";
-                    // PrintSafely(s.str());
-                }
-                else
-                {
-                    break;
-                }
-            } while (in.commitTransaction() == false);
-            // }
+            { 800ms, 8 },   // level 2
+            { 2ms, 1 },     // level 0
+            { 30ms, 4 },    // level 1
+            { 700ms, 7 },   // level 2
+            { 3ms, 2 },     // level 1, right past level 0
+            { 300ms, 6 },   // level 1
+            { 30ms, 5 },    // same due, after 4
+            { -1ms, 0 },    // already due
+        };
+    vector<Clock::time_point> due(schedule.size());
+    for (auto [delay, item]: schedule)
+    {
+        due[item] = origin + delay;
+        wheel.schedule(due[item], item);
+    }
+    // due right after level 0 wraps at tick 512: the first one waits in level 1 until then,
+    // the second is scheduled close enough to go to level 0 directly, where the first is appended behind it
+    auto const late = origin + 5200us;
+    wheel.schedule(late, 100);
+    std::this_thread::sleep_until(origin + 3500us);
+    wheel.schedule(late, 101);
+    wheel.drain();
+    wheel.stop();
+
+    vector<int> order;
+    auto onTime = true;
+    for (auto const& [item, at]: released)
+    {
+        order.push_back(item);
+        onTime = onTime && at >= (item >= 100 ? late : due[item]);
+    }
+    check("timer wheel released everything", released.size() == schedule.size() + 2);
+    check("timer wheel never early", onTime);
+    check("timer wheel in due order across levels", order == vector<int>{ 0, 1, 2, 100, 101, 4, 5, 6, 7, 8 });
+    return ret;
+}
+
+bool unitTestPermutation()
+{
+    auto ret = true;
+    auto check = [&ret] (string const& what, bool ok)
+    {
+        cout << what << (ok ? " ok" : " FAILED") << endl;
+        ret = ret && ok;
+    };
 
-            if (msg.length())
+    // every value of the small widths, the odd ones cycle walk out of the extra bit of the network
+    auto bijective = true;
+    for (auto bits=1; bits<=16; ++bits)
+    {
+        for (uint64_t seed: { uint64_t{0}, uint64_t{42}, ~uint64_t{0} })
+        {
+            permutation::Feistel const permute{bits, seed};
+            vector<bool> seen(permute.getMax() + 1);
+            for (uint64_t value=0; value<=permute.getMax(); ++value)
             {
-                // PrintSafely(s.str());
-                auto asMessage = from_string(msg.toStdString());
-                if (asMessage)
+                auto const image = permute(value);
+                bijective = bijective && image <= permute.getMax() && seen[image] == false;
+                if (image <= permute.getMax())
                 {
-                    receiveQueue.push(*asMessage);
-                }
-                else
-                {
-                    PrintSafely("Failed to parse json: " + msg.toStdString());
+                    seen[image] = true;
                 }
             }
         }
-        PrintSafely("end listen thread");
     }
+    check("feistel bijective from 1 to 16 bits", bijective);
+
+    auto const first = permutation::Feistel{32, 7};
+    auto const same = permutation::Feistel{32, 7};
+    auto const other = permutation::Feistel{32, 8};
+    auto reproducible = true;
+    auto differ = 0;
+    for (uint64_t value=0; value<1000; ++value)
+    {
+        reproducible = reproducible && first(value) == same(value);
+        differ += first(value) != other(value);
+    }
+    check("feistel reproducible from the seed", reproducible && differ > 990);
 
-    void talk()
+    auto const wide = permutation::Feistel{64, 1};
+    check("feistel 64 bits", wide.getMax() == ~uint64_t{0} && wide(~uint64_t{0}) != wide(0));
+
+    auto throws = [] (auto&& call)
     {
-        auto& socket = talkSocket;
-        socket = make_shared<QTcpSocket>();
-        // PrintSafely("localhost = " + localhost.toStdString());
-        socket->connectToHost(localhost, port);
-        PrintSafely("talking on port " + to_string(port));
-        if (socket->waitForConnected(3000) == false)
+        try
         {
-            throw std::runtime_error(to_string(id) + " talk thread Failed to connect socket to port " + to_string(port));
+            call();
         }
-        while (finished == false)
+        catch (std::runtime_error const&)
         {
-            sleep();
-            ostringstream s;
-            s << "\ttalk\t\t";
-            // s << " socket state " << (int)socket->state();
-
-            auto message = sendQueue.pop();
-            if (message)
-            {
-                printMessage(*message, Direction::Send, "still in queue: " + to_string(sendQueue.size()));
-// #warning "re enable delay"
-                std::this_thread::sleep_for(chrono::milliseconds(static_cast<int>(1000 * delay)));
-                QByteArray block;
-                QDataStream out(&block, QIODevice::WriteOnly);
-                out.setVersion(dataStreamVersion);
-                auto asString = to_string(*message);
-                // auto asString = string{"message defg"};
-                out << QString::fromStdString(asString);
-                socket->write(block);
-                s << " WRITTEN '" << asString << "'";
-
-                socket->waitForBytesWritten();
-                // socket->flush();
-
-                // PrintSafely(s.str());
-            }
+            return true;
         }
-        socket->disconnectFromHost();
-        PrintSafely("end talk thread");
-    }
+        return false;
+    };
+    check("feistel rejects what is out of range",
+        throws([] { permutation::Feistel{0, 0}; }) &&
+        throws([] { permutation::Feistel{65, 0}; }) &&
+        throws([] { permutation::Feistel{5, 0}(32); }));
+    return ret;
+}
 
-    void process()
+bool unitTestInput()
+{
+    auto ret = true;
+    auto check = [&ret] (string const& what, bool ok)
     {
-        enum struct State
-        {
-            Offline,
-            Participating,
-            Decided,
-            Leader,
-        } state = State::Offline;
-
-        peers.insert(id);
-
-        // auto startTime =  std::chrono::system_clock::now();
-        auto allReady = false;
-
-        // spec says "then it will send a message indicating its unique ID"
-        // which is ambiguous as regards the message type
-        // we will thus call this message Greetings
-        // no need to protect for parallel access before we start the other threads
-        sendQueue.messages.push({ id, Message::Type::Greetings, "" });
-
-        listenThread = std::make_shared<thread>(&Node::listen, this);
-        std::this_thread::sleep_for(1000ms);
+        cout << what << (ok ? " ok" : " FAILED") << endl;
+        ret = ret && ok;
+    };
 
-        talkThread = std::make_shared<thread>(&Node::talk, this);
-        while (finished == false)
+    auto const path = filesystem::temp_directory_path() / ("ring-unit-test-" + std::to_string(::getpid()) + ".bin");
+    struct Read
+    {
+        bool hasIDs = false;
+        vector<float> delays;
+        vector<uint64_t> ids;
+    };
+    // nothing when the file is rejected
+    auto read = [&path] () -> optional<Read>
+    {
+        Read ret;
+        try
         {
-            sleep();
-            ostringstream s;
-            s << "\tprocess\t";
-
-            // s << &sendQueue.messages;
-            // PrintSafely(s.str());
-            auto stateDescription =
-                string{"participating:"} +
-                ((state == State::Participating) ? "yes" : "no");
-
-            if (auto optionalMsg = receiveQueue.pop())
-            {
-                auto msg = *optionalMsg;
-                auto actionDescription = string{};
-
-                if (msg.type == Message::Type::Greetings)
-                {
-                    if (msg.id != id)
-                    {
-                        peers.insert(msg.id);
-                        actionDescription += "forwarding";
-                        sendQueue.push(msg);
-                    }
-                    else
-                    {
-                        allReady = true;
-                        actionDescription += "noop";
-                        // PrintSafely("greetings size "  + to_string(peers.size()));
-                    }
-                }
-                else if (msg.type == Message::Type::ElectionStart)
-                {
-                    if (msg.id > id)
-                    {
-                        // unconditionally forward
-                        state = State::Participating;
-                        actionDescription += "forwarding";
-                        sendQueue.push(msg);
-                    }
-                    else if (msg.id < id)
-                    {
-                        if (state != State::Participating)
-                        {
-                            // replace the UID in the message with my own UID and send
-                            state = State::Participating;
-                            msg.id = id;
-                            actionDescription += "forwarding with my id";
-                            sendQueue.push(msg);
-                        }
-                        else
-                        {
-                            // discard the election message
-                            actionDescription += "noop";
-                        }
-                    }
-                    else
-                    {
-                        // i am the leader
-                        assert(msg.id == id);
-                        leader = id;
-                        state = State::Leader;
-                        actionDescription += "sending i am the leader";
-                        sendQueue.push({ id, Message::Type::ElectedLeader, "" });
-                    }
-                }
-                else if (msg.type == Message::Type::ElectedLeader)
+            input::read(path,
+                [&ret] (size_t count, bool hasIDs) { ret.hasIDs = hasIDs; ret.delays.reserve(count); },
+                [&ret] (size_t, float delay, optional<uint64_t> id)
                 {
-                    if (msg.id != id)
-                    {
-                        // marks myself as a decided, record the elected UID, and forward
-                        state = State::Decided;
-                        leader = msg.id;
-                        actionDescription += "forwarding";
-                        sendQueue.push(msg);
-                    }
-                    else
+                    ret.delays.push_back(delay);
+                    if (id)
                     {
-                        actionDescription += "noop";
-                        // election is over
+                        ret.ids.push_back(*id);
                     }
-                    assert(leader);
-                    finished = true;
-                }
-                printMessage(msg, Direction::Receive, stateDescription + ", " + actionDescription);
-                if (finished)
-                {
-                    PrintSafely("OUR LEADER IS " + to_string(*leader));
-                }
-            }
-
-            if (state == State::Offline
-                && allReady // waiting for my peers to be ready
-                )
-            {
-                /* no need to wait a grace period
-                   because we know when all peers are ready
-                auto secondsSinceStart = std::chrono::duration_cast<std::chrono::seconds>(
-                    std::chrono::system_clock::now() - startTime).count();
-                if (secondsSinceStart > 5)
-                */
-                {
-                    // we notice the lack of a leader
-                    state = State::Participating;
-                    PrintSafely("noticed lack of a leader, " + stateDescription + ", starting an election");
-                    sendQueue.push(Message{id, Message::Type::ElectionStart, "something"});
-                }
-            }
+                },
+                [] (size_t, size_t) {});
         }
-    }
-};
-mutex Node::printLock;
-string const Node::outputPath = "output.log";
+        catch (std::runtime_error const&)
+        {
+            return nullopt;
+        }
+        return ret;
+    };
+    vector<float> const delays = { 0.01f, 0.0f, 1.5e-6f, 3.25f };
+    vector<uint64_t> const ids = { 1, 0, ~uint64_t{0}, 0x0123456789abcdef };
+    input::writeBinary(path, delays, {});
+    auto const withoutIDs = read();
+    check("binary input round trip without IDs", withoutIDs && withoutIDs->hasIDs == false && withoutIDs->delays == delays && withoutIDs->ids.empty());
+    input::writeBinary(path, delays, ids);
+    auto const withIDs = read();
+    check("binary input round trip with IDs", withIDs && withIDs->hasIDs && withIDs->delays == delays && withIDs->ids == ids);
 
-auto generateNodes(vector<float> const& delays)
+    auto const size = filesystem::file_size(path);
+    filesystem::resize_file(path, size - 1);
+    check("binary input rejects a truncated node", !read());
+    filesystem::resize_file(path, input::headerSize - 1);
+    check("binary input rejects a truncated header", !read());
+    input::writeBinary(path, delays, ids);
+    filesystem::resize_file(path, size + sizeof(float));
+    check("binary input rejects trailing bytes", !read());
+    input::writeBinary(path, {}, {});
+    check("binary input rejects zero node", !read());
+    filesystem::remove(path);
+    return ret;
+}
+
+bool unitTestCollision()
 {
-    vector<Node> nodes;
-    for (auto const& delay: delays)
+    auto ret = true;
+    auto check = [&ret] (string const& what, bool ok)
     {
-        nodes.emplace_back(delay);
-    }
-    for (size_t i=0; i<nodes.size(); ++i)
+        cout << what << (ok ? " ok" : " FAILED") << endl;
+        ret = ret && ok;
+    };
+
+    // small enough for the exact product: 1 - M (M - 1) ... (M - n + 1) / M^n
+    for (auto bits: { 1, 3, 8 })
     {
-        cout <<
-            std::setfill('0') << std::setw(5) <<
-            nodes[i].getID() << "\t";
-        if (i == 0)
-        {
-            cout << "↖";
-        }
-        else if (i == nodes.size() - 1)
+        auto const m = std::ldexp(1.0, bits);
+        auto exact = [m] (double n)
         {
-            cout << "↗";
-        }
-        else
+            auto noCollision = 1.0;
+            for (auto i=0.0; i<n; ++i)
+            {
+                noCollision *= std::max(0.0, (m - i) / m);
+            }
+            return 1 - noCollision;
+        };
+        auto closed = true;
+        for (auto n=1.0; n<=m + 1; ++n)
         {
-            cout << "↑";
+            closed = closed && std::abs(analysis::collisionProbability(n, bits) - exact(n)) < 1e-9;
         }
-        cout << endl;
-        if (i != nodes.size() - 1)
+        check("collision probability of " + std::to_string(bits) + " bits", closed);
+        // the rows of printCollisionProbability: the count reaches the probability, and one less does not
+        auto smallest = true;
+        for (auto probability: { 0.000001, 0.01, 0.5, 0.99 })
         {
-            cout << "↓" << endl;
+            auto const nodes = analysis::nodesForCollision(probability, bits);
+            smallest = smallest && nodes >= 2 && nodes <= m + 1 &&
+                exact(nodes) >= probability && exact(nodes - 1) < probability;
         }
+        check("nodes for a collision of " + std::to_string(bits) + " bits", smallest);
     }
-    return nodes;
+    return ret;
 }
 
-void verifyUniqueIDs(vector<Node> const& nodes)
+// e.g. ./main --unit-tests, exits with a failure when a check failed
+bool unitTests()
 {
-    set<Limits::IDType> ids;
-    for (auto const& node: nodes)
+    auto ret = true;
+    for (auto test: { unitTestJson, unitTestWire, unitTestSpsc, unitTestTimerWheel, unitTestPermutation, unitTestInput, unitTestCollision })
     {
-        auto id = node.getID();
-        if (ids.count(id))
-        {
-            throw std::runtime_error("This ID is not unique, assigned to multiple nodes: " + std::to_string(id));
-        }
-        ids.insert(id);
+        ret = test() && ret;
     }
+    return ret;
 }
 
-void startNodes(vector<Node>& nodes)
+// for IDs drawn at random, like the clock ones, the permuted ones never collide
+// a row per power of two of nodes up to the whole ID space, then the ring sizes of a few probabilities
+void printCollisionProbability(int bits)
 {
-    // clear the log file
-    try
+    auto print = [] (double nodes, double probability)
     {
-        filesystem::remove(Node::outputPath);
-    }
-    catch (std::exception const&) { }
-
-    // link to neighbor and start processing, listening and talking
-    for (size_t i=0; i<nodes.size(); ++i)
+        std::cout << "probability of a collision for " << std::setprecision(0) << std::fixed << nodes << " nodes = \t" <<
+            std::setprecision(4) << std::defaultfloat << probability * 100 << "%" << endl;
+    };
+    std::cout << "IDs of " << bits << " bits" << endl;
+    // until a collision is all but certain
+    auto probability = 0.0;
+    for (auto i=0; i<=bits && probability < 0.999999; ++i)
     {
-        // std::cout << "index " << i << " neighbor " << (i + nodes.size() - 1) % nodes.size() << std::endl;
-        auto const& counterClockwiseNeighbor =
-            nodes.at((i + nodes.size() - 1) % nodes.size());
-        nodes[i].linkAndStart(counterClockwiseNeighbor.getPort());
+        auto const nodes = std::ldexp(1.0, i);
+        probability = analysis::collisionProbability(nodes, bits);
+        print(nodes, probability);
     }
-    for (auto const& node: nodes)
+    // the smallest ring that reaches each probability, once when a small ID space reaches several with the same one
+    auto previous = 0.0;
+    for (auto probability: { 0.000001, 0.01, 0.5, 0.99 })
     {
-        node.printDescription();
+        auto const nodes = analysis::nodesForCollision(probability, bits);
+        if (nodes != previous)
+        {
+            print(nodes, analysis::collisionProbability(nodes, bits));
+        }
+        previous = nodes;
     }
 }
 
-void endWork(vector<Node>& nodes)
+// feeds every node of a trace its recorded steps again, through the same code as the runtimes,
+// and checks that it sends and goes through exactly what the trace says it did
+void replay(Options const& options)
 {
-    while (std::any_of(nodes.begin(), nodes.end(), [] (Node const& node) {
-        return node.getFinished() == false; }))
+    auto const recorded = trace::read(options.replayPath);
+    if (options.chromePath.empty() == false)
     {
-        std::this_thread::sleep_for(100ms);
+        trace::writeChrome(recorded, options.chromePath);
+        std::cout << "Chrome trace of " << recorded.events.size() << " events written to " << options.chromePath.string() << endl;
     }
-    for (auto& node: nodes)
+    if (recorded.dropped)
     {
-        node.join();
+        std::cout << recorded.dropped << " events were dropped while recording, each node is replayed up to the end of its trace" << endl;
+    }
+    vector<vector<trace::Event>> byNode(recorded.ids.size());
+    for (auto const& event: recorded.events)
+    {
+        byNode[event.node].push_back(event);
+    }
+    vector<Node> nodes;
+    nodes.reserve(recorded.ids.size());
+    for (auto id: recorded.ids)
+    {
+        nodes.emplace_back(id, 0.0f, recorded.algorithm, recorded.discovery);
     }
 
-    auto leader = nodes.front().getLeader();
-    if (std::any_of(nodes.begin(), nodes.end(), [&leader, &nodes] (Node const& node) {
-        if (!node.getLeader())
+    vector<trace::Event> replayed;
+    trace::capture(&replayed);
+    auto send = [] (Message const&, election::Side) {};
+    size_t tracedNodes = 0;
+    set<Limits::IDType> leaders;
+    for (size_t i=0; i<nodes.size(); ++i)
+    {
+        auto const& events = byNode[i];
+        size_t next = 0;
+        while (next < events.size())
         {
-            cout << "Leader: none for id " << node.getID() << endl;
-            return true;
+            auto const& step = events[next];
+            replayed.clear();
+            if (step.kind == trace::Kind::Begin)
+            {
+                nodes[i].begin(send, step.phase != 0);
+            }
+            else if (step.kind == trace::Kind::BeginReady)
+            {
+                nodes[i].beginReady(send);
+            }
+            else if (step.kind == trace::Kind::Receive)
+            {
+                nodes[i].receive(step.toMessage(), step.getSide(), send);
+            }
+            else
+            {
+                throw std::runtime_error("Node " + to_string(i) + " sends or changes state without a step at its event " + to_string(next));
+            }
+            // the step itself, then what it caused
+            for (auto const& event: replayed)
+            {
+                if (next == events.size())
+                {
+                    break;
+                }
+                if (trace::same(event, events[next]) == false)
+                {
+                    throw std::runtime_error("Node " + to_string(i) + " departs from the trace at its event " + to_string(next));
+                }
+                ++next;
+            }
         }
-        if (node.getLeader() != leader)
+        if (events.empty() == false)
         {
-            cout << "Leaders differ: " << to_string(*node.getLeader()) << " for " << to_string(node.getID()) <<
-                " and " << (leader ? to_string(*leader) : "none") << " for " << to_string(nodes.front().getID()) <<
-                endl;
+            ++tracedNodes;
         }
-        return false; }))
+        if (auto leader = nodes[i].getLeader())
+        {
+            leaders.insert(*leader);
+        }
+    }
+    trace::capture(nullptr);
+    std::cout << "Replayed " << recorded.events.size() << " events of " << tracedNodes << " nodes, all as traced" << endl;
+    if (leaders.size() > 1)
     {
-        throw std::runtime_error("No consensus");
+        throw std::runtime_error("No consensus in the trace");
+    }
+    if (leaders.size() == 1)
+    {
+        std::cout << "Leader " << *leaders.begin() << endl;
     }
 }
 
-void unitTestJson()
+// the distributions of many simulated elections on rings the size of the input, or on its graph, see analysis.hpp
+void analyze(vector<Node> const& nodes, Options const& options, uint64_t seed, topology::Graph const* graph)
 {
-    vector<json::Message::Type> types =
-        {
-            json::Message::Type::Greetings,
-            json::Message::Type::ElectionStart,
-            json::Message::Type::ElectedLeader
-        };
-    for (auto type: types)
+    vector<float> delays;
+    delays.reserve(nodes.size());
+    for (auto const& node: nodes)
     {
-        json::Message m = { 5584, type, "iorjjkgfd" };
-        auto s = json::to_string(m);
-        cout << endl << s << endl;
-        auto m2 = json::from_string(s);
-        cout << endl << (m2 ? "parsed" : "empty") << endl;
-        if (m2)
-        {
-            cout << endl << json::to_string(*m2) << endl;
-        }
+        delays.emplace_back(node.getDelay());
+    }
+    auto wallStart = std::chrono::steady_clock::now();
+    auto const trials = analysis::run(options.trials, delays, options.algorithm, options.discovery, options.idBits, seed, options.workers, graph, options.hierarchy);
+    auto wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    vector<double> messages;
+    vector<double> times;
+    for (auto const& trial: trials)
+    {
+        messages.emplace_back(static_cast<double>(trial.messages));
+        times.emplace_back(trial.electionTime);
     }
+    auto print = [] (string const& name, analysis::Summary const& summary)
+    {
+        std::cout << name << ": mean " << summary.mean << ", p50 " << summary.p50 <<
+            ", p99 " << summary.p99 << ", max " << summary.max << endl;
+    };
+    std::cout << trials.size() << " elections of " << nodes.size() << " nodes on " <<
+        std::min(options.workers, trials.size()) << " workers in " << wallTime << " s" << endl;
+    print("Messages", analysis::summarize(messages));
+    print("Seconds to consensus", analysis::summarize(times));
+    printCollisionProbability(options.idBits);
 }
 
-void printCollisionProbability()
+int main(int argc, char** argv)
 {
-    auto probabilityOfACollision = [] (int numberOfNodes) {
-        auto const totalIDs = 65536;
-        auto remainingIDs = totalIDs;
-        auto probaNoCollision = 1.0f;
+    if (argc == 2 && string_view{argv[1]} == "--unit-tests")
+    {
+        return unitTests() ? 0 : 1;
+    }
 
-        for (int i=0; i<numberOfNodes; ++i)
-        {
-            probaNoCollision *= (float)remainingIDs / totalIDs;
-            if (probaNoCollision < 0.00001)
-            {
-                break;
-            }
-            --remainingIDs;
-        }
-        return 1 - probaNoCollision;
-    };
+    auto options = parseCommandLine(argc, argv);
 
-    for (int i=0; i<=65536; ++i)
+    if (options.replayPath.empty() == false)
     {
-        std::cout <<
-            "probability of a collision for " << i << " nodes = \t" <<
-            std::fixed <<
-            std::setprecision(2) <<
-            probabilityOfACollision(i) * 100 << "%" << endl;
+        replay(options);
+        return 0;
     }
-}
 
-int main(int argc, char** argv)
-{
-    // printCollisionProbability();
-    // return 0;
+    auto const seed = options.seed ? *options.seed : (uint64_t{std::random_device{}()} << 32 | std::random_device{}());
+    std::cout << "ID seed: " << seed << std::endl;
+
+    if (options.convertPath.empty() == false)
+    {
+        convertInput(options, seed);
+        return 0;
+    }
 
-    // unitTestJson();
-    // return 0;
+    auto fixedIDs = false;
+    vector<topology::Edge> edges;
+    auto nodes = loadNodes(options, seed, fixedIDs, edges);
+    auto const graph = buildGraph(nodes.size(), options, std::move(edges), seed);
 
-    auto inputFile = parseCommandLine(argc, argv);
+    if (fixedIDs || options.ids == IDOrder::Clock)
+    {
+        verifyUniqueIDs(nodes);
+    }
+
+    if (options.trials)
+    {
+        analyze(nodes, options, seed, graph ? &*graph : nullptr);
+        return 0;
+    }
 
-    auto delays = parseInput(inputFile);
+    if (options.runtime == Runtime::Simulation)
+    {
+        auto measurement = simulate(nodes, options, graph ? &*graph : nullptr);
+        if (options.reportPath.empty() == false)
+        {
+            writeReport(options, measurement);
+        }
+        return 0;
+    }
 
-    auto nodes = generateNodes(delays);
+    if (options.metricsPath.empty() == false)
+    {
+        std::signal(SIGUSR1, [] (int) { snapshotRequested = 1; });
+    }
 
-    verifyUniqueIDs(nodes);
+    if (options.runtime == Runtime::Processes)
+    {
+        auto measurement = launch(nodes, options);
+        if (options.reportPath.empty() == false)
+        {
+            writeReport(options, measurement);
+        }
+        return 0;
+    }
 
-    startNodes(nodes);
+    auto wallStart = std::chrono::steady_clock::now();
+    // writes the messages of all the nodes of the threads runtime
+    Node::Wheel wheel{&Node::release};
+    if (options.runtime == Runtime::Threads)
+    {
+        wheel.start();
+    }
+    Node::Startup startup{linkCount(nodes.size(), options.algorithm)};
+    linkNodes(nodes, options.algorithm);
+    Latch decisions{nodes.size()};
+    for (auto& node: nodes)
+    {
+        node.reportDecision(decisions);
+    }
+    if (options.tracePath.empty() == false)
+    {
+        startTrace(nodes, options, options.tracePath);
+    }
+    startNodes(nodes, options, wheel, startup);
 
-    endWork(nodes);
+    if (options.runtime == Runtime::Pool)
+    {
+        runtime::Pool<Node> pool{nodes, options.workers};
+        pool.start();
+        waitForDecisions(nodes, decisions, options.metricsPath);
+    }
+    else
+    {
+        waitForDecisions(nodes, decisions, options.metricsPath);
+    }
+    auto electionTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    shutDown(nodes, wheel, options.metricsPath);
+    auto wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    stopTrace();
+    logging::stop();
+    checkConsensus(outcomes(nodes));
+    if (options.reportPath.empty() == false)
+    {
+        writeReport(options, measure(outcomes(nodes), wallTime, electionTime));
+    }
     std::cout << "end main()" << std::endl;
 
     return 0;
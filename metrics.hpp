@@ -0,0 +1,261 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "json.hpp"
+#include "election.hpp"
+
+using namespace std;
+using namespace json;
+
+// What a node measures while it runs, read by another thread for a snapshot at any time.
+// Every field is a relaxed atomic: writers never wait, and a snapshot is only consistent field by field.
+namespace metrics
+{
+    using Clock = chrono::steady_clock;
+
+    auto microseconds(Clock::duration duration)
+    {
+        return static_cast<uint64_t>(std::max<int64_t>(0, chrono::duration_cast<chrono::microseconds>(duration).count()));
+    }
+
+    // Log-linear buckets like an HDR histogram: values below 2^subBits are exact,
+    // and every power of two above is split in 2^subBits buckets, so a percentile is within 1/2^subBits of the value.
+    // Values beyond 2^rangeBits, about 12 days in microseconds, are counted in the last bucket.
+    class Histogram
+    {
+    public:
+        void record(uint64_t value)
+        {
+            counts[index(value)].fetch_add(1, memory_order_relaxed);
+            total.fetch_add(1, memory_order_relaxed);
+            sum.fetch_add(value, memory_order_relaxed);
+            auto seen = maximum.load(memory_order_relaxed);
+            while (value > seen && maximum.compare_exchange_weak(seen, value, memory_order_relaxed) == false)
+            {
+            }
+        }
+
+        void add(Histogram const& other)
+        {
+            for (size_t i=0; i<bucketCount; ++i)
+            {
+                counts[i].fetch_add(other.counts[i].load(memory_order_relaxed), memory_order_relaxed);
+            }
+            total.fetch_add(other.total.load(memory_order_relaxed), memory_order_relaxed);
+            sum.fetch_add(other.sum.load(memory_order_relaxed), memory_order_relaxed);
+            auto const otherMaximum = other.maximum.load(memory_order_relaxed);
+            auto seen = maximum.load(memory_order_relaxed);
+            while (otherMaximum > seen && maximum.compare_exchange_weak(seen, otherMaximum, memory_order_relaxed) == false)
+            {
+            }
+        }
+
+        auto getCount() const { return total.load(memory_order_relaxed); }
+        auto getMax() const { return maximum.load(memory_order_relaxed); }
+        auto getMean() const
+        {
+            auto const count = getCount();
+            return count ? static_cast<double>(sum.load(memory_order_relaxed)) / count : 0.0;
+        }
+
+        // the upper bound of the bucket holding the given fraction of the values
+        uint64_t getPercentile(double fraction) const
+        {
+            auto const count = getCount();
+            if (count == 0)
+            {
+                return 0;
+            }
+            auto const rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * count + 0.5));
+            uint64_t seen = 0;
+            for (size_t i=0; i<bucketCount; ++i)
+            {
+                seen += counts[i].load(memory_order_relaxed);
+                if (seen >= rank)
+                {
+                    return std::min(upperBound(i), getMax());
+                }
+            }
+            return getMax();
+        }
+
+    private:
+        static int constexpr subBits = 4;
+        static int constexpr rangeBits = 40;
+        static size_t constexpr subCount = size_t{1} << subBits;
+        static size_t constexpr bucketCount = (rangeBits - subBits + 1) * subCount;
+
+        array<atomic<uint64_t>, bucketCount> counts{};
+        atomic<uint64_t> total{0};
+        atomic<uint64_t> sum{0};
+        atomic<uint64_t> maximum{0};
+
+        static size_t index(uint64_t value)
+        {
+            if (value < subCount)
+            {
+                return value;
+            }
+            auto const shift = 63 - __builtin_clzll(value) - subBits;
+            return std::min(bucketCount - 1, (shift + 1) * subCount + ((value >> shift) & (subCount - 1)));
+        }
+
+        static uint64_t upperBound(size_t index)
+        {
+            if (index < subCount)
+            {
+                return index;
+            }
+            auto const shift = index / subCount - 1;
+            auto const mantissa = (index & (subCount - 1)) | subCount;
+            return ((mantissa + 1) << shift) - 1;
+        }
+    };
+
+    // the queues of the threads runtime, where a message spends its time between two state machines
+    struct QueueMetrics
+    {
+        atomic<uint64_t> pending{0}; // messages of the node in the timer wheel
+        Histogram inFlight;          // pending, when the process thread schedules one more
+        Histogram receiveQueueDepth; // when a listen thread pushes
+        // microseconds spent by a message at each stage of a hop:
+        Histogram linkWait;          // scheduled to written by the wheel thread, the link delay included
+        Histogram receiveQueueWait;  // listen thread to process thread
+
+        void add(QueueMetrics const& other)
+        {
+            pending.fetch_add(other.pending.load(memory_order_relaxed), memory_order_relaxed);
+            inFlight.add(other.inFlight);
+            receiveQueueDepth.add(other.receiveQueueDepth);
+            linkWait.add(other.linkWait);
+            receiveQueueWait.add(other.receiveQueueWait);
+        }
+    };
+
+    class NodeMetrics
+    {
+    public:
+        static size_t constexpr typeCount = static_cast<size_t>(Message::lastType) + 1;
+        static size_t constexpr stateCount = static_cast<size_t>(election::State::Leader) + 1;
+
+        array<atomic<uint64_t>, typeCount> sent{};
+        array<atomic<uint64_t>, typeCount> received{};
+        atomic<uint64_t> bytesSent{0};
+        // only allocated for the threads runtime, before its threads start, so that pooled nodes stay small
+        unique_ptr<QueueMetrics> queues;
+
+        void count(atomic<uint64_t>& counter, uint64_t value = 1) { counter.fetch_add(value, memory_order_relaxed); }
+        void countSent(Message const& msg) { count(sent[static_cast<size_t>(msg.type)]); }
+        void countReceived(Message const& msg) { count(received[static_cast<size_t>(msg.type)]); }
+
+        // called by the thread driving the state machine, first when it starts
+        void enter(election::State state, Clock::time_point now = Clock::now())
+        {
+            auto const since = Clock::time_point{Clock::duration{stateSince.exchange(now.time_since_epoch().count(), memory_order_relaxed)}};
+            auto const previous = current.exchange(static_cast<int>(state), memory_order_relaxed);
+            if (previous >= 0)
+            {
+                count(stateTime[previous], microseconds(now - since));
+            }
+        }
+
+        // microseconds in the given state, counting the current one until now
+        uint64_t getStateTime(size_t state, Clock::time_point now) const
+        {
+            auto ret = stateTime[state].load(memory_order_relaxed);
+            if (current.load(memory_order_relaxed) == static_cast<int>(state))
+            {
+                ret += microseconds(now - Clock::time_point{Clock::duration{stateSince.load(memory_order_relaxed)}});
+            }
+            return ret;
+        }
+
+        void add(NodeMetrics const& other, Clock::time_point now)
+        {
+            for (size_t i=0; i<typeCount; ++i)
+            {
+                count(sent[i], other.sent[i].load(memory_order_relaxed));
+                count(received[i], other.received[i].load(memory_order_relaxed));
+            }
+            for (size_t i=0; i<stateCount; ++i)
+            {
+                count(stateTime[i], other.getStateTime(i, now));
+            }
+            count(bytesSent, other.bytesSent.load(memory_order_relaxed));
+            if (other.queues)
+            {
+                if (queues == nullptr)
+                {
+                    queues = make_unique<QueueMetrics>();
+                }
+                queues->add(*other.queues);
+            }
+        }
+
+    private:
+        array<atomic<uint64_t>, stateCount> stateTime{};
+        atomic<int> current{-1};
+        atomic<Clock::rep> stateSince{0};
+    };
+
+    void writeJson(ostream& out, Histogram const& histogram)
+    {
+        out << "{ \"count\": " << histogram.getCount() <<
+            ", \"mean\": " << histogram.getMean() <<
+            ", \"p50\": " << histogram.getPercentile(0.5) <<
+            ", \"p90\": " << histogram.getPercentile(0.9) <<
+            ", \"p99\": " << histogram.getPercentile(0.99) <<
+            ", \"max\": " << histogram.getMax() << " }";
+    }
+
+    // the fields of a JSON object, without the braces so that the caller can add its own
+    void writeJson(ostream& out, NodeMetrics const& metrics, Clock::time_point now, string const& indent)
+    {
+        auto writeCounts = [&out] (array<atomic<uint64_t>, NodeMetrics::typeCount> const& counts)
+        {
+            out << "{";
+            for (size_t i=0; i<counts.size(); ++i)
+            {
+                out << (i ? ", \"" : " \"") << json::describe(static_cast<Message::Type>(i)) << "\": " << counts[i].load(memory_order_relaxed);
+            }
+            out << " }";
+        };
+
+        out << indent << "\"sent\": ";
+        writeCounts(metrics.sent);
+        out << ",\n" << indent << "\"received\": ";
+        writeCounts(metrics.received);
+        out << ",\n" << indent << "\"bytes_sent\": " << metrics.bytesSent.load(memory_order_relaxed);
+        out << ",\n" << indent << "\"state_us\": {";
+        for (size_t i=0; i<NodeMetrics::stateCount; ++i)
+        {
+            out << (i ? ", \"" : " \"") << election::describe(static_cast<election::State>(i)) << "\": " << metrics.getStateTime(i, now);
+        }
+        out << " }";
+        if (metrics.queues == nullptr)
+        {
+            return;
+        }
+        auto const& queues = *metrics.queues;
+        out << ",\n" << indent << "\"pending\": " << queues.pending.load(memory_order_relaxed);
+        pair<char const*, Histogram const*> histograms[] =
+            {
+                { "in_flight", &queues.inFlight },
+                { "receive_queue_depth", &queues.receiveQueueDepth },
+                { "link_wait_us", &queues.linkWait },
+                { "receive_queue_wait_us", &queues.receiveQueueWait },
+            };
+        for (auto const& [name, histogram]: histograms)
+        {
+            out << ",\n" << indent << "\"" << name << "\": ";
+            writeJson(out, *histogram);
+        }
+    }
+}
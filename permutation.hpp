@@ -0,0 +1,81 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+namespace permutation
+{
+    // a good 64-bit mixer, from SplitMix64, used both for the round keys and as the round function
+    uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    // A keyed bijection of [0, 2^bits): distinct inputs always give distinct outputs,
+    // so the images of 0..N-1 are N distinct IDs that look random, without remembering the ones already given.
+    // A balanced Feistel network works on an even number of bits, one more than asked when bits is odd:
+    // it then cycle walks, applying itself again until the value falls back in range, twice on average at worst.
+    // Not meant to be cryptographically strong, only well mixed and reproducible from the seed.
+    class Feistel
+    {
+    public:
+        Feistel(int bits, uint64_t seed) :
+            bits(bits),
+            halfBits((bits + 1) / 2)
+        {
+            if (bits < 1 || bits > 64)
+            {
+                throw std::runtime_error("ID width out of 1 to 64 bits: " + std::to_string(bits));
+            }
+            for (auto& key: keys)
+            {
+                seed = mix(seed);
+                key = seed;
+            }
+        }
+
+        // the largest value, 2^bits - 1
+        uint64_t getMax() const { return bits == 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1; }
+
+        uint64_t operator()(uint64_t value) const
+        {
+            if (value > getMax())
+            {
+                throw std::runtime_error("Value out of the " + std::to_string(bits) + "-bit permutation: " + std::to_string(value));
+            }
+            do
+            {
+                value = network(value);
+            }
+            while (value > getMax());
+            return value;
+        }
+
+    private:
+        static int constexpr roundCount = 4;
+
+        int bits;
+        int halfBits;
+        array<uint64_t, roundCount> keys;
+
+        uint64_t network(uint64_t value) const
+        {
+            auto const mask = (uint64_t{1} << halfBits) - 1;
+            auto left = value >> halfBits;
+            auto right = value & mask;
+            for (auto key: keys)
+            {
+                auto const next = left ^ (mix(right ^ key) & mask);
+                left = right;
+                right = next;
+            }
+            return (left << halfBits) | right;
+        }
+    };
+}
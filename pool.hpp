@@ -0,0 +1,146 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "json.hpp"
+#include "election.hpp"
+
+using namespace std;
+using namespace json;
+
+namespace runtime
+{
+    // Runs every node as a state machine on a fixed set of worker threads instead of three threads per node.
+    // Nodes are sharded by index so that a node is only ever touched by its own worker,
+    // and the link delay becomes the due time of the delivery instead of a blocked thread.
+    template <typename Node>
+    class Pool
+    {
+    public:
+        Pool(vector<Node>& nodes, size_t workerCount) :
+            nodes(nodes)
+        {
+            workerCount = std::clamp<size_t>(workerCount, 1, nodes.size());
+            for (size_t i=0; i<workerCount; ++i)
+            {
+                shards.emplace_back(make_unique<Shard>());
+            }
+        }
+        ~Pool() { stop(); }
+
+        void start()
+        {
+            // the workers are not running yet, so the nodes can be started from this thread
+            // the first node initiates the discovery when there is a single initiator
+            for (size_t i=0; i<nodes.size(); ++i)
+            {
+                nodes[i].begin(sender(i), i == 0);
+            }
+            for (auto& shard: shards)
+            {
+                shard->worker = thread{&Pool::work, this, std::ref(*shard)};
+            }
+        }
+
+        void stop()
+        {
+            for (auto& shard: shards)
+            {
+                {
+                    lock_guard<mutex> guard{shard->lock};
+                    shard->stopping = true;
+                }
+                shard->wake.notify_one();
+            }
+            for (auto& shard: shards)
+            {
+                if (shard->worker.joinable())
+                {
+                    shard->worker.join();
+                }
+            }
+        }
+
+    private:
+        using Clock = chrono::steady_clock;
+        struct Delivery
+        {
+            Clock::time_point due;
+            uint64_t sequence; // keeps deliveries due at the same time in send order
+            size_t to;
+            election::Side from; // as seen by the receiver
+            Message message;
+        };
+        struct Later
+        {
+            bool operator()(Delivery const& a, Delivery const& b) const
+            {
+                return std::tie(a.due, a.sequence) > std::tie(b.due, b.sequence);
+            }
+        };
+        struct Shard
+        {
+            mutex lock;
+            condition_variable wake;
+            priority_queue<Delivery, vector<Delivery>, Later> pending;
+            uint64_t sequence = 0;
+            bool stopping = false;
+            thread worker;
+        };
+
+        vector<Node>& nodes;
+        vector<unique_ptr<Shard>> shards;
+
+        auto sender(size_t from)
+        {
+            return [this, from] (Message const& msg, election::Side side) { send(from, msg, side); };
+        }
+
+        void send(size_t from, Message const& msg, election::Side side)
+        {
+            // node i talks clockwise to node i+1, and counter-clockwise to node i-1
+            auto const count = nodes.size();
+            auto to = side == election::Side::Clockwise ? (from + 1) % count : (from + count - 1) % count;
+            auto delay = chrono::duration<float>{nodes[from].getDelay()};
+            auto due = Clock::now() + chrono::duration_cast<Clock::duration>(delay);
+            auto& shard = *shards[to % shards.size()];
+            {
+                lock_guard<mutex> guard{shard.lock};
+                shard.pending.push({ due, shard.sequence++, to, election::opposite(side), msg });
+            }
+            shard.wake.notify_one();
+        }
+
+        void work(Shard& shard)
+        {
+            unique_lock<mutex> guard{shard.lock};
+            while (shard.stopping == false)
+            {
+                if (shard.pending.empty())
+                {
+                    shard.wake.wait(guard);
+                    continue;
+                }
+                auto due = shard.pending.top().due;
+                if (Clock::now() < due)
+                {
+                    shard.wake.wait_until(guard, due);
+                    continue;
+                }
+                auto delivery = shard.pending.top();
+                shard.pending.pop();
+                guard.unlock();
+                nodes[delivery.to].receive(delivery.message, delivery.from, sender(delivery.to));
+                guard.lock();
+            }
+        }
+    };
+}
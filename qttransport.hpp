@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+// QT sockets: sudo apt install qt6-base-dev
+#include <QTcpSocket>
+#include <QTcpServer>
+
+#include "json.hpp"
+#include "transport.hpp"
+#include "wire.hpp"
+
+using namespace std;
+using namespace json;
+
+namespace transport
+{
+    // TCP on the loopback, the endpoint is mapped to a port number by the caller
+    class QtTcp
+    {
+    private:
+        static auto constexpr timeoutMs = 3000;
+        static int constexpr dataStreamVersion = QDataStream::Qt_5_10;
+
+    public:
+        class Sender : public transport::Sender
+        {
+        public:
+            Sender(int port, wire::Format format, Report report) :
+                port(port), format(format), report(std::move(report))
+            {
+            }
+            void connect() override
+            {
+                socket = make_shared<QTcpSocket>();
+                socket->connectToHost(QHostAddress::LocalHost, port);
+                if (socket->waitForConnected(timeoutMs) == false)
+                {
+                    throw std::runtime_error("Failed to connect socket to port " + std::to_string(port));
+                }
+            }
+            using transport::Sender::send;
+            // the whole batch goes out in a single write
+            void send(Message const* messages, size_t count) override
+            {
+                qint64 size = 0;
+                qint64 written = 0;
+                if (format == wire::Format::Text)
+                {
+                    QByteArray block;
+                    QDataStream out(&block, QIODevice::WriteOnly);
+                    out.setVersion(dataStreamVersion);
+                    for (size_t i=0; i<count; ++i)
+                    {
+                        out << QString::fromStdString(json::to_string(messages[i]));
+                    }
+                    size = block.size();
+                    written = socket->write(block);
+                }
+                else
+                {
+                    frames.resize(std::max(frames.size(), count * wire::maxFrameSize));
+                    for (size_t i=0; i<count; ++i)
+                    {
+                        size += wire::encode(messages[i], frames.data() + size, frames.size() - size);
+                    }
+                    written = socket->write(frames.data(), size);
+                }
+                if (written != size)
+                {
+                    report(logging::Level::Error, "Failed to send on port " + std::to_string(port) + ": " + socket->errorString().toStdString());
+                    return;
+                }
+                bytesSent += size;
+                // false as well when everything already left, so only what is still buffered is an error
+                if (socket->waitForBytesWritten(timeoutMs) == false && socket->bytesToWrite() > 0)
+                {
+                    report(logging::Level::Error, "Failed to flush " + std::to_string(socket->bytesToWrite()) + " bytes on port " +
+                        std::to_string(port) + ": " + socket->errorString().toStdString());
+                }
+            }
+            void disconnect() override { socket->disconnectFromHost(); }
+            string describe() const override { return "port " + std::to_string(port); }
+        private:
+            int const port;
+            wire::Format const format;
+            Report const report;
+            vector<char> frames; // grows to the largest batch
+            shared_ptr<QTcpSocket> socket;
+        };
+
+        class Receiver : public transport::Receiver
+        {
+        public:
+            Receiver(int port, wire::Format format, Report report) :
+                port(port), format(format), report(std::move(report)), buffer(wire::maxFrameSize)
+            {
+            }
+            void open() override
+            {
+                server = make_shared<QTcpServer>();
+                if (server->listen(QHostAddress::LocalHost, port) == false)
+                {
+                    throw std::runtime_error("Failed to listen on port " + std::to_string(port));
+                }
+            }
+            void accept() override
+            {
+                server->waitForNewConnection(timeoutMs);
+                socket = server->nextPendingConnection();
+                if (socket == nullptr)
+                {
+                    throw std::runtime_error("nobody connected before timeout on port " + std::to_string(port));
+                }
+                in = make_unique<QDataStream>(socket);
+                in->setVersion(dataStreamVersion);
+            }
+            bool receive(chrono::milliseconds timeout, function<void(Message const&)> const& deliver) override
+            {
+                if (format == wire::Format::Text)
+                {
+                    receiveText(timeout, deliver);
+                }
+                else
+                {
+                    receiveBinary(timeout, deliver);
+                }
+                // the sender is gone once the socket is closed and everything it sent was read
+                if (socket->state() != QAbstractSocket::UnconnectedState)
+                {
+                    return true;
+                }
+                if (incomplete)
+                {
+                    // the end of the frame may have come with the close, otherwise the rest of it never will
+                    decodeText(deliver);
+                    return false;
+                }
+                return socket->bytesAvailable() > 0;
+            }
+            string describe() const override { return "port " + std::to_string(port); }
+
+        private:
+            int const port;
+            wire::Format const format;
+            Report const report;
+            shared_ptr<QTcpServer> server;
+            QTcpSocket* socket = nullptr; // owned by the server
+            unique_ptr<QDataStream> in;
+            // waitForReadyRead only reports new data, so remember when an incomplete frame is buffered
+            bool incomplete = false;
+            // one frame always fits after the consumed ones are dropped, so a partial frame can always complete
+            vector<char> buffer;
+            size_t used = 0;
+
+            bool waitForData(chrono::milliseconds timeout)
+            {
+                if (incomplete == false && socket->bytesAvailable() > 0)
+                {
+                    return true;
+                }
+                return socket->waitForReadyRead(static_cast<int>(timeout.count()));
+            }
+
+            void receiveText(chrono::milliseconds timeout, function<void(Message const&)> const& deliver)
+            {
+                if (waitForData(timeout) == false)
+                {
+                    return;
+                }
+                decodeText(deliver);
+            }
+
+            void decodeText(function<void(Message const&)> const& deliver)
+            {
+                incomplete = false;
+                while (socket->bytesAvailable() > 0)
+                {
+                    QString msg;
+                    in->startTransaction();
+                    *in >> msg;
+                    if (in->commitTransaction() == false)
+                    {
+                        // incomplete frame: wait for the rest of it
+                        incomplete = true;
+                        return;
+                    }
+                    if (msg.length() == 0)
+                    {
+                        continue;
+                    }
+                    auto asString = msg.toStdString();
+                    MessageView view;
+                    auto error = json::parse(asString, view);
+                    if (error == ParseError::None)
+                    {
+                        deliver(view.toMessage());
+                    }
+                    else
+                    {
+                        report(logging::Level::Error, "Failed to parse json (" + string{json::describe(error)} + "): " + asString);
+                    }
+                }
+            }
+
+            void receiveBinary(chrono::milliseconds timeout, function<void(Message const&)> const& deliver)
+            {
+                if (waitForData(timeout) == false)
+                {
+                    return;
+                }
+                auto read = socket->read(buffer.data() + used, buffer.size() - used);
+                if (read <= 0)
+                {
+                    return;
+                }
+                used += read;
+
+                size_t offset = 0;
+                while (true)
+                {
+                    wire::FrameView frame;
+                    size_t consumed = 0;
+                    auto status = wire::decode(buffer.data() + offset, used - offset, frame, consumed);
+                    if (status == wire::Status::Incomplete)
+                    {
+                        break;
+                    }
+                    if (status != wire::Status::Ok)
+                    {
+                        // the stream cannot be resynchronized after a bad header
+                        report(logging::Level::Error, "Failed to decode frame, dropping " + std::to_string(used - offset) + " bytes");
+                        offset = used;
+                        break;
+                    }
+                    deliver(frame.toMessage());
+                    offset += consumed;
+                }
+                memmove(buffer.data(), buffer.data() + offset, used - offset);
+                used -= offset;
+            }
+        };
+    };
+}
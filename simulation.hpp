@@ -0,0 +1,530 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "json.hpp"
+#include "election.hpp"
+#include "topology.hpp"
+#include "wire.hpp"
+
+using namespace std;
+using namespace json;
+
+namespace simulation
+{
+    using election::ID;
+
+    // a leader crashed on purpose, and how long the ring took to notice it and to agree on another one
+    struct Failover
+    {
+        ID leader;
+        double detection = 0; // virtual seconds from the crash to the first neighbor suspecting it
+        double recovery = 0;  // virtual seconds from the crash to the last node deciding on the next leader
+        uint64_t messages = 0; // of the election of the next leader
+    };
+
+    struct Result
+    {
+        double electionTime = 0; // virtual seconds until the last node decided
+        uint64_t messages = 0;
+        uint64_t bytes = 0; // as binary frames
+        vector<optional<ID>> leaders;
+        vector<bool> crashed;
+        uint64_t heartbeats = 0; // not counted in the messages nor the bytes
+        vector<Failover> failovers;
+    };
+
+    // Failover mode: every node sends a heartbeat to both neighbors at each interval, and once the ring agrees on a leader,
+    // the leader crashes. Its neighbors notice the silence, splice the ring around it and start the next epoch.
+    // The run stops once the ring agreed after the last crash.
+    struct Crashes
+    {
+        size_t leaders = 0; // no heartbeat when 0
+        double heartbeat = 0.1;
+        double timeout = 0.3;
+    };
+
+    // Discrete-event run of the same state machine as Node::process, on a virtual clock.
+    // Like Node::talk, each message arrives the delay of its sender after it was sent, whatever else is on the link,
+    // so the virtual time is the one the threaded runtime would take without its startup overhead.
+    // The run is deterministic: events due at the same time are delivered in the order they were sent.
+    auto run(vector<ID> const& ids, vector<float> const& delays, election::Algorithm algorithm,
+        election::Discovery discovery = election::Discovery::Flood, Crashes const& crashes = {})
+    {
+        enum struct Kind
+        {
+            Deliver,
+            Tick,  // a node sends its heartbeats and checks those of its neighbors
+            Crash, // of the leader
+        };
+        struct Event
+        {
+            double time;
+            uint64_t sequence;
+            size_t to;
+            election::Side from; // as seen by the receiver
+            Message message;
+            Kind kind = Kind::Deliver;
+            size_t beyond = 0; // in a heartbeat, the neighbor of the sender on the far side, to splice the ring to
+        };
+        struct Later
+        {
+            bool operator()(Event const& a, Event const& b) const
+            {
+                return std::tie(a.time, a.sequence) > std::tie(b.time, b.sequence);
+            }
+        };
+
+        auto const count = ids.size();
+        vector<election::Machine> machines;
+        machines.reserve(count);
+        for (auto id: ids)
+        {
+            machines.emplace_back(algorithm, id);
+        }
+        // the ring as it is spliced around the crashed nodes, indexed by the side of the node
+        vector<array<size_t, 2>> neighbors(count);
+        // what each node knows of its neighbors, and of the nodes beyond them
+        vector<array<election::FailureDetector, 2>> detectors(count, { election::FailureDetector{crashes.timeout}, election::FailureDetector{crashes.timeout} });
+        vector<array<size_t, 2>> beyond(count);
+        for (size_t i=0; i<count; ++i)
+        {
+            neighbors[i] = { (i + 1) % count, (i + count - 1) % count };
+        }
+        auto const index = [] (election::Side side) { return side == election::Side::Clockwise ? 0 : 1; };
+        priority_queue<Event, vector<Event>, Later> events;
+        uint64_t sequence = 0;
+        auto now = 0.0;
+        Result result;
+        result.crashed.resize(count);
+        auto alive = count;
+
+        auto sender = [&] (size_t from)
+        {
+            return [&, from] (Message const& msg, election::Side side)
+            {
+                auto to = neighbors[from][index(side)];
+                events.push({ now + delays[from], sequence++, to, election::opposite(side), msg });
+                ++result.messages;
+                result.bytes += wire::frameSize(msg);
+            };
+        };
+
+        // the nodes that decided in each epoch, the ring agrees once all those alive decided in the last one
+        vector<size_t> decided(1);
+        uint32_t lastEpoch = 0;
+        // a node that decided in an epoch may join the next one and decide in it on the same message, without ever being unfinished
+        auto decide = [&] (size_t node, bool wasFinished, uint32_t wasEpoch)
+        {
+            auto const& machine = machines[node];
+            lastEpoch = std::max(lastEpoch, machine.getEpoch());
+            if (machine.getFinished() && (wasFinished == false || machine.getEpoch() != wasEpoch))
+            {
+                decided.resize(std::max<size_t>(decided.size(), machine.getEpoch() + 1));
+                ++decided[machine.getEpoch()];
+            }
+            return decided.size() > lastEpoch && decided[lastEpoch] == alive;
+        };
+
+        // with heartbeats the events never run out, so an election that does not end stops the run after a bound:
+        // the detection of a crash, then 16 hops per node of the slowest sender, past the longest an election and its announcement take
+        auto const slowest = count ? *std::max_element(delays.begin(), delays.end()) : 0.0f;
+        auto const bound = crashes.timeout + 2 * crashes.heartbeat + 16.0 * (count + 1) * slowest;
+        auto deadline = bound;
+
+        auto crashesLeft = crashes.leaders;
+        auto electing = true;
+        optional<Failover> failover;
+        auto crashedAt = 0.0;
+        uint64_t messagesBefore = 0;
+        // returns true when the run is over
+        auto agreed = [&] ()
+        {
+            if (failover)
+            {
+                failover->recovery = now - crashedAt;
+                failover->messages = result.messages - messagesBefore;
+                result.failovers.push_back(*failover);
+                failover.reset();
+            }
+            else
+            {
+                result.electionTime = now;
+            }
+            if (crashesLeft && alive > 1)
+            {
+                --crashesLeft;
+                deadline = now + bound;
+                // once the heartbeats of the spliced neighbors went through
+                events.push({ now + crashes.heartbeat, sequence++, 0, election::Side::Clockwise, Message{}, Kind::Crash });
+                return false;
+            }
+            return true;
+        };
+
+        for (size_t i=0; i<count; ++i)
+        {
+            machines[i].start(sender(i), discovery, i == 0);
+            if (crashes.leaders)
+            {
+                events.push({ 0, sequence++, i, election::Side::Clockwise, Message{}, Kind::Tick });
+            }
+        }
+        while (events.empty() == false)
+        {
+            auto event = events.top();
+            events.pop();
+            now = event.time;
+            auto const node = event.to;
+            if (crashes.leaders && now > deadline)
+            {
+                throw std::runtime_error("No agreement " + (failover ? "after the crash of " + std::to_string(failover->leader) : string{"on a first leader"}) +
+                    " within " + std::to_string(bound) + " virtual seconds, " + std::to_string(alive) + " nodes alive");
+            }
+            if (event.kind == Kind::Crash)
+            {
+                for (size_t i=0; i<count; ++i)
+                {
+                    if (result.crashed[i] == false && machines[i].getState() == election::State::Leader)
+                    {
+                        result.crashed[i] = true;
+                        --alive;
+                        failover = Failover{ ids[i] };
+                        crashedAt = now;
+                        electing = true;
+                        messagesBefore = result.messages;
+                        deadline = now + bound;
+                        break;
+                    }
+                }
+                continue;
+            }
+            if (result.crashed[node])
+            {
+                continue;
+            }
+            if (event.kind == Kind::Tick)
+            {
+                for (auto side: { election::Side::Clockwise, election::Side::CounterClockwise })
+                {
+                    auto const i = index(side);
+                    events.push({ now + delays[node], sequence++, neighbors[node][i], election::opposite(side),
+                        Message{ ids[node], Message::Type::Heartbeat, "" }, Kind::Deliver, neighbors[node][1 - i] });
+                    ++result.heartbeats;
+                    auto const suspect = detectors[node][i].suspect(now);
+                    if (!suspect)
+                    {
+                        continue;
+                    }
+                    if (failover && failover->detection == 0)
+                    {
+                        failover->detection = now - crashedAt;
+                    }
+                    // splices both ends at once, so that the node beyond does not have to notice too
+                    auto const next = beyond[node][i];
+                    neighbors[node][i] = next;
+                    neighbors[next][1 - i] = node;
+                    detectors[node][i].forget();
+                    detectors[next][1 - i].forget();
+                    if (machines[node].getLeader() == suspect)
+                    {
+                        auto const wasFinished = machines[node].getFinished();
+                        auto const wasEpoch = machines[node].getEpoch();
+                        machines[node].reelect(sender(node));
+                        decide(node, wasFinished, wasEpoch);
+                    }
+                }
+                events.push({ now + crashes.heartbeat, sequence++, node, election::Side::Clockwise, Message{}, Kind::Tick });
+                continue;
+            }
+            if (event.message.type == Message::Type::Heartbeat)
+            {
+                auto const i = index(event.from);
+                // a late heartbeat of the node the ring was spliced around
+                if (event.message.id != ids[neighbors[node][i]])
+                {
+                    continue;
+                }
+                detectors[node][i].heard(event.message.id, now);
+                beyond[node][i] = event.beyond;
+                continue;
+            }
+            auto& machine = machines[node];
+            auto const wasFinished = machine.getFinished();
+            auto const wasEpoch = machine.getEpoch();
+            machine.receive(event.message, event.from, sender(node));
+            machine.startIfReady(sender(node));
+            if (decide(node, wasFinished, wasEpoch) && electing)
+            {
+                electing = false;
+                if (agreed())
+                {
+                    break;
+                }
+            }
+        }
+
+        for (auto const& machine: machines)
+        {
+            result.leaders.emplace_back(machine.getLeader());
+        }
+        return result;
+    }
+
+    // The same kind of run for the echo on any graph: every node starts its wave at once,
+    // like the nodes of the threads runtime once their links are up, and a message takes the delay of its sender over any edge.
+    auto runGraph(topology::Graph const& graph, vector<ID> const& ids, vector<float> const& delays)
+    {
+        struct Event
+        {
+            double time;
+            uint64_t sequence;
+            size_t to;
+            size_t port; // of the receiver
+            Message message;
+        };
+        struct Later
+        {
+            bool operator()(Event const& a, Event const& b) const
+            {
+                return std::tie(a.time, a.sequence) > std::tie(b.time, b.sequence);
+            }
+        };
+
+        auto const count = ids.size();
+        vector<election::EchoWave> machines;
+        machines.reserve(count);
+        for (size_t i=0; i<count; ++i)
+        {
+            machines.emplace_back(ids[i], graph.neighbors(i).size());
+        }
+        priority_queue<Event, vector<Event>, Later> events;
+        uint64_t sequence = 0;
+        auto now = 0.0;
+        Result result;
+        result.crashed.resize(count);
+
+        auto sender = [&] (size_t from)
+        {
+            return [&, from] (Message const& msg, size_t port)
+            {
+                events.push({ now + delays[from], sequence++, graph.neighbors(from)[port], graph.remotePort(from, port), msg });
+                ++result.messages;
+                result.bytes += wire::frameSize(msg);
+            };
+        };
+
+        size_t decided = 0;
+        for (size_t i=0; i<count; ++i)
+        {
+            machines[i].start(sender(i));
+            decided += machines[i].getFinished();
+        }
+        while (events.empty() == false && decided < count)
+        {
+            auto const event = events.top();
+            events.pop();
+            now = event.time;
+            auto& machine = machines[event.to];
+            auto const wasFinished = machine.getFinished();
+            machine.receive(event.message, event.port, sender(event.to));
+            if (wasFinished == false && machine.getFinished() && ++decided == count)
+            {
+                result.electionTime = now;
+            }
+        }
+
+        for (auto const& machine: machines)
+        {
+            result.leaders.emplace_back(machine.getLeader());
+        }
+        return result;
+    }
+
+    // The announce of a leader learned elsewhere around a ring, from the given node, with the ElectedLeader of the ring algorithms:
+    // every node decides on what reaches it, through the same machines, and the node it started from drops it once it is back.
+    auto runAnnounce(vector<ID> const& ids, vector<float> const& delays, size_t from, ID leader)
+    {
+        struct Event
+        {
+            double time;
+            uint64_t sequence;
+            size_t to;
+            Message message;
+        };
+        struct Later
+        {
+            bool operator()(Event const& a, Event const& b) const
+            {
+                return std::tie(a.time, a.sequence) > std::tie(b.time, b.sequence);
+            }
+        };
+
+        auto const count = ids.size();
+        vector<election::Machine> machines;
+        machines.reserve(count);
+        for (auto id: ids)
+        {
+            machines.emplace_back(election::Algorithm::ChangRoberts, id);
+        }
+        priority_queue<Event, vector<Event>, Later> events;
+        uint64_t sequence = 0;
+        auto now = 0.0;
+        Result result;
+        result.crashed.resize(count);
+        auto sender = [&] (size_t node)
+        {
+            return [&, node] (Message const& msg, election::Side)
+            {
+                events.push({ now + delays[node], sequence++, (node + 1) % count, msg });
+                ++result.messages;
+                result.bytes += wire::frameSize(msg);
+            };
+        };
+
+        if (count > 1)
+        {
+            sender(from)(Message{ leader, Message::Type::ElectedLeader, "" }, election::Side::Clockwise);
+        }
+        while (events.empty() == false)
+        {
+            auto const event = events.top();
+            events.pop();
+            now = event.time;
+            if (event.to == from)
+            {
+                continue;
+            }
+            machines[event.to].receive(event.message, election::Side::CounterClockwise, sender(event.to));
+            result.electionTime = now;
+        }
+
+        for (size_t i=0; i<count; ++i)
+        {
+            result.leaders.emplace_back(i == from ? optional<ID>{leader} : machines[i].getLeader());
+        }
+        return result;
+    }
+
+    // a run of the hierarchical mode, by level
+    struct Hierarchy
+    {
+        Result result; // of the whole ring, with the leader each node ended with
+        size_t groups = 0;
+        double lowerTime = 0; // virtual seconds until the slowest sub-ring elected its leader
+        double upperTime = 0; // of the election between the leaders of the sub-rings
+        double downTime = 0;  // of the slowest announce of the global leader around a sub-ring
+        uint64_t lowerMessages = 0;
+        uint64_t upperMessages = 0;
+    };
+
+    // Hierarchical mode: the ring is cut into sub-rings of consecutive nodes, of the given size or of about sqrt(N) nodes when 0,
+    // each elects a leader with the algorithm, the leaders elect the global leader on a ring of their own,
+    // and each of them announces the one it decided on around its sub-ring with an ElectedLeader.
+    // Every level runs through the machines, so the leaders of the result are those the nodes actually decided on.
+    // With sub-rings of sqrt(N) nodes, every level is about sqrt(N) hops long instead of the N of a single ring.
+    // The levels follow each other, so the upper ring starts once the slowest sub-ring decided, as if a barrier separated them,
+    // and the sub-rings are simulated in parallel on the given number of threads.
+    auto runHierarchy(vector<ID> const& ids, vector<float> const& delays, election::Algorithm algorithm,
+        election::Discovery discovery, size_t groupSize, size_t workers = 1)
+    {
+        auto const count = ids.size();
+        if (groupSize == 0)
+        {
+            groupSize = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+        }
+        Hierarchy ret;
+        ret.groups = (count + groupSize - 1) / groupSize;
+        // as even as possible, the first node of each is its place in the upper ring
+        auto const first = [&] (size_t group) { return count * group / ret.groups; };
+
+        // runs each sub-ring on its own IDs and delays
+        auto const eachGroup = [&] (auto&& simulate)
+        {
+            atomic<size_t> next{0};
+            auto work = [&] ()
+            {
+                for (auto group = next.fetch_add(1, memory_order_relaxed); group < ret.groups; group = next.fetch_add(1, memory_order_relaxed))
+                {
+                    vector<ID> groupIDs{ids.begin() + first(group), ids.begin() + first(group + 1)};
+                    vector<float> groupDelays{delays.begin() + first(group), delays.begin() + first(group + 1)};
+                    simulate(group, groupIDs, groupDelays);
+                }
+            };
+            vector<thread> threads;
+            for (size_t i=1; i<std::min(workers, ret.groups); ++i)
+            {
+                threads.emplace_back(work);
+            }
+            work();
+            for (auto& thread: threads)
+            {
+                thread.join();
+            }
+        };
+
+        vector<Result> lower(ret.groups);
+        eachGroup([&] (size_t group, vector<ID> const& groupIDs, vector<float> const& groupDelays) {
+            lower[group] = run(groupIDs, groupDelays, algorithm, discovery);
+        });
+
+        // the leaders talk to each other with their own delay, like any node
+        vector<ID> upperIDs;
+        vector<float> upperDelays;
+        vector<size_t> leaderIndices;
+        for (size_t group=0; group<ret.groups; ++group)
+        {
+            auto const& result = lower[group];
+            auto const leader = result.leaders.front().value();
+            auto const index = static_cast<size_t>(std::find(ids.begin() + first(group), ids.begin() + first(group + 1), leader) - ids.begin());
+            upperIDs.push_back(leader);
+            upperDelays.push_back(delays[index]);
+            leaderIndices.push_back(index);
+            ret.lowerTime = std::max(ret.lowerTime, result.electionTime);
+            ret.lowerMessages += result.messages;
+            ret.result.bytes += result.bytes;
+        }
+        auto const upper = run(upperIDs, upperDelays, algorithm, discovery);
+        ret.upperTime = upper.electionTime;
+        ret.upperMessages = upper.messages;
+        ret.result.bytes += upper.bytes;
+
+        // a leader of a sub-ring that did not decide in the upper ring has nothing to announce, its nodes keep no leader
+        vector<Result> down(ret.groups);
+        eachGroup([&] (size_t group, vector<ID> const& groupIDs, vector<float> const& groupDelays) {
+            auto const& decided = upper.leaders[group];
+            if (decided)
+            {
+                down[group] = runAnnounce(groupIDs, groupDelays, leaderIndices[group] - first(group), *decided);
+            }
+            else
+            {
+                down[group].leaders.resize(groupIDs.size());
+            }
+        });
+        ret.result.leaders.reserve(count);
+        for (auto const& result: down)
+        {
+            ret.downTime = std::max(ret.downTime, result.electionTime);
+            ret.result.messages += result.messages;
+            ret.result.bytes += result.bytes;
+            ret.result.leaders.insert(ret.result.leaders.end(), result.leaders.begin(), result.leaders.end());
+        }
+
+        ret.result.electionTime = ret.lowerTime + ret.upperTime + ret.downTime;
+        ret.result.messages += ret.lowerMessages + ret.upperMessages;
+        ret.result.crashed.resize(count);
+        return ret;
+    }
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+using namespace std;
+
+// Wakes up a consumer blocked on one or more queues.
+// The consumer announces that it sleeps, and only in that case does a producer take the mutex.
+class Doorbell
+{
+public:
+    // producer side, after the item is published
+    void ring()
+    {
+        // orders the publication before reading the flag, pairs with the fence in wait
+        atomic_thread_fence(memory_order_seq_cst);
+        if (sleeping.load(memory_order_relaxed))
+        {
+            lock_guard<mutex> guard{lock};
+            wake.notify_all();
+        }
+    }
+
+    // consumer side, returns when ready() holds or after the timeout
+    template <typename Ready>
+    void wait(chrono::milliseconds timeout, Ready&& ready)
+    {
+        unique_lock<mutex> guard{lock};
+        sleeping.store(true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        wake.wait_for(guard, timeout, ready);
+        sleeping.store(false, memory_order_relaxed);
+    }
+
+    // consumer side, returns only when ready() holds
+    template <typename Ready>
+    void wait(Ready&& ready)
+    {
+        unique_lock<mutex> guard{lock};
+        sleeping.store(true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        wake.wait(guard, ready);
+        sleeping.store(false, memory_order_relaxed);
+    }
+
+private:
+    atomic<bool> sleeping{false};
+    mutex lock;
+    condition_variable wake;
+};
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// push and pop only touch the two indices, each on its own cache line.
+// The consumer may block in waitPop, several queues may share the doorbell of a consumer that waits on all of them.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(is_trivially_copyable_v<T>, "slots are overwritten in place");
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "the capacity must be a power of two");
+
+public:
+    explicit SpscQueue(shared_ptr<Doorbell> doorbell = make_shared<Doorbell>()) :
+        doorbell(std::move(doorbell))
+    {
+    }
+
+    // producer side, returns false when the queue is full
+    bool tryPush(T const& item)
+    {
+        auto const head = producer.head.load(memory_order_relaxed);
+        if (head - producer.cachedTail == Capacity)
+        {
+            producer.cachedTail = consumer.tail.load(memory_order_acquire);
+            if (head - producer.cachedTail == Capacity)
+            {
+                return false;
+            }
+        }
+        slots[head & (Capacity - 1)] = item;
+        producer.head.store(head + 1, memory_order_release);
+        doorbell->ring();
+        return true;
+    }
+
+    // producer side, waits for the consumer to make room
+    void push(T const& item)
+    {
+        while (tryPush(item) == false)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    // consumer side
+    optional<T> pop()
+    {
+        auto const tail = consumer.tail.load(memory_order_relaxed);
+        if (tail == consumer.cachedHead)
+        {
+            consumer.cachedHead = producer.head.load(memory_order_acquire);
+            if (tail == consumer.cachedHead)
+            {
+                return {};
+            }
+        }
+        auto item = slots[tail & (Capacity - 1)];
+        consumer.tail.store(tail + 1, memory_order_release);
+        return item;
+    }
+
+    // consumer side, blocks until an item is pushed, or returns empty after the timeout
+    optional<T> waitPop(chrono::milliseconds timeout)
+    {
+        if (auto item = pop())
+        {
+            return item;
+        }
+        doorbell->wait(timeout, [this] { return size() > 0; });
+        return pop();
+    }
+
+    // approximate when called concurrently with push or pop
+    size_t size() const
+    {
+        return producer.head.load(memory_order_acquire) - consumer.tail.load(memory_order_acquire);
+    }
+
+private:
+    struct alignas(64) Producer
+    {
+        atomic<uint64_t> head{0};
+        uint64_t cachedTail = 0;
+    };
+    struct alignas(64) Consumer
+    {
+        atomic<uint64_t> tail{0};
+        uint64_t cachedHead = 0;
+    };
+    Producer producer;
+    Consumer consumer;
+    shared_ptr<Doorbell> const doorbell;
+    array<T, Capacity> slots;
+};
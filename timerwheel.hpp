@@ -0,0 +1,197 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+namespace timing
+{
+    // Hierarchical timer wheel (Varghese and Lauck): one thread releases the items of every node when they are due.
+    // Level 0 has a slot per tick, each level above a slot per turn of the level below,
+    // so scheduling and releasing are constant time whatever the number of items in flight.
+    // An item is cascaded down a level each time the level below wraps, until it reaches its slot of level 0.
+    template <typename T>
+    class TimerWheel
+    {
+    public:
+        using Clock = chrono::steady_clock;
+        // called on the wheel thread with all the items due at a tick, in the order they were scheduled
+        using Release = function<void(vector<T>&)>;
+
+        explicit TimerWheel(Release release, Clock::duration tick = 1ms) :
+            release(std::move(release)),
+            tick(tick)
+        {
+        }
+        ~TimerWheel() { stop(); }
+
+        void start()
+        {
+            origin = Clock::now();
+            stopping = false;
+            worker = thread{&TimerWheel::run, this};
+        }
+
+        // items still in the wheel are dropped
+        void stop()
+        {
+            {
+                lock_guard<mutex> guard{lock};
+                stopping = true;
+            }
+            wake.notify_one();
+            drained.notify_all();
+            if (worker.joinable())
+            {
+                worker.join();
+            }
+        }
+
+        // waits until every item scheduled so far is released, and the release call is over
+        void drain()
+        {
+            unique_lock<mutex> guard{lock};
+            drained.wait(guard, [this] { return (count == 0 && releasing == false) || stopping; });
+        }
+
+        // thread safe, an item already due is released at the next tick
+        void schedule(Clock::time_point due, T item)
+        {
+            {
+                lock_guard<mutex> guard{lock};
+                if (count == 0)
+                {
+                    // the wheel does not turn while empty
+                    current = std::max<uint64_t>(current, (Clock::now() - origin) / tick);
+                }
+                auto const ticks = (due - origin + tick - Clock::duration{1}) / tick;
+                insert({ std::max<uint64_t>(current + 1, std::max<int64_t>(0, ticks)), sequence++, std::move(item) });
+                ++count;
+            }
+            wake.notify_one();
+        }
+
+    private:
+        static int constexpr levelBits = 8;
+        static size_t constexpr slotCount = size_t{1} << levelBits;
+        static int constexpr levelCount = 4; // 2^32 ticks, 49 days of 1 ms
+
+        struct Entry
+        {
+            uint64_t due; // in ticks since origin
+            uint64_t sequence;
+            T item;
+        };
+
+        Release const release;
+        Clock::duration const tick;
+        Clock::time_point origin;
+        array<array<vector<Entry>, slotCount>, levelCount> levels;
+        uint64_t current = 0; // the last tick released
+        uint64_t sequence = 0;
+        size_t count = 0;
+        bool stopping = false;
+        bool releasing = false;
+        mutex lock;
+        condition_variable wake;
+        condition_variable drained;
+        thread worker;
+
+        void insert(Entry entry)
+        {
+            auto const delta = entry.due - current;
+            for (int level=0; level<levelCount; ++level)
+            {
+                if (level == levelCount - 1 || delta < (uint64_t{1} << (levelBits * (level + 1))))
+                {
+                    auto const slot = (entry.due >> (levelBits * level)) & (slotCount - 1);
+                    levels[level][slot].push_back(std::move(entry));
+                    return;
+                }
+            }
+        }
+
+        // moves to the next tick and collects what is due at it
+        void advance(vector<Entry>& due)
+        {
+            ++current;
+            // when a level wraps, the current slot of the level above now fits in the levels below
+            for (int level=1; level<levelCount; ++level)
+            {
+                if (((current >> (levelBits * (level - 1))) & (slotCount - 1)) != 0)
+                {
+                    break;
+                }
+                auto& slot = levels[level][(current >> (levelBits * level)) & (slotCount - 1)];
+                auto cascaded = std::move(slot);
+                slot.clear();
+                for (auto& entry: cascaded)
+                {
+                    insert(std::move(entry));
+                }
+            }
+            auto& slot = levels[0][current & (slotCount - 1)];
+            for (auto& entry: slot)
+            {
+                due.push_back(std::move(entry));
+            }
+            count -= slot.size();
+            slot.clear();
+        }
+
+        void run()
+        {
+            vector<Entry> due;
+            vector<T> items;
+            unique_lock<mutex> guard{lock};
+            while (stopping == false)
+            {
+                if (count == 0)
+                {
+                    drained.notify_all();
+                    wake.wait(guard);
+                    continue;
+                }
+                auto const next = origin + tick * (current + 1);
+                if (Clock::now() < next)
+                {
+                    wake.wait_until(guard, next);
+                    continue;
+                }
+                // catches up with every tick that elapsed
+                auto const now = static_cast<uint64_t>((Clock::now() - origin) / tick);
+                due.clear();
+                while (current < now && count)
+                {
+                    advance(due);
+                }
+                if (due.empty())
+                {
+                    continue;
+                }
+                releasing = true;
+                guard.unlock();
+                // items cascaded from an upper level may land behind items scheduled later for the same tick
+                std::sort(due.begin(), due.end(), [] (Entry const& a, Entry const& b) {
+                    return std::tie(a.due, a.sequence) < std::tie(b.due, b.sequence); });
+                items.clear();
+                for (auto& entry: due)
+                {
+                    items.push_back(std::move(entry.item));
+                }
+                release(items);
+                guard.lock();
+                releasing = false;
+            }
+        }
+    };
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "permutation.hpp"
+
+using namespace std;
+
+// Who talks to whom, when the nodes are not on a ring: an undirected connected graph,
+// where each node numbers its neighbors from 0, its ports, in increasing node order.
+namespace topology
+{
+    using Edge = pair<size_t, size_t>;
+
+    enum struct Kind
+    {
+        Ring,    // the historical one, node i between i-1 and i+1
+        Torus,   // a grid of rows and columns wrapped around both ways, degree 4
+        Tree,    // complete k-ary tree, node i under node (i-1)/k
+        Regular, // random, each node with the given even degree, see randomRegular
+        Edges,   // the edges of the input file
+    };
+
+    // the parameter is the rows of a torus, the arity of a tree, the degree of a regular graph, 0 for a default
+    struct Spec
+    {
+        Kind kind = Kind::Ring;
+        size_t parameter = 0;
+    };
+
+    // compressed rows: the neighbors of node i are targets[offsets[i]] to targets[offsets[i+1]-1]
+    class Graph
+    {
+    public:
+        struct Neighbors
+        {
+            size_t const* first;
+            size_t const* last;
+            auto begin() const { return first; }
+            auto end() const { return last; }
+            auto size() const { return static_cast<size_t>(last - first); }
+            auto operator[](size_t port) const { return first[port]; }
+        };
+
+        // the duplicated edges are merged, throws on a loop, on an unknown node, or when the graph is not connected
+        Graph(size_t count, vector<Edge> edges)
+        {
+            for (auto& [a, b]: edges)
+            {
+                if (a >= count || b >= count)
+                {
+                    throw std::runtime_error("Edge " + std::to_string(a) + " " + std::to_string(b) + " out of " + std::to_string(count) + " nodes");
+                }
+                if (a == b)
+                {
+                    throw std::runtime_error("Loop on node " + std::to_string(a));
+                }
+            }
+            auto const edgeCount = edges.size();
+            for (size_t i=0; i<edgeCount; ++i)
+            {
+                edges.emplace_back(edges[i].second, edges[i].first);
+            }
+            std::sort(edges.begin(), edges.end());
+            edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+            offsets.assign(count + 1, 0);
+            targets.reserve(edges.size());
+            for (auto [a, b]: edges)
+            {
+                ++offsets[a + 1];
+                targets.push_back(b);
+            }
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            reverse.resize(targets.size());
+            for (size_t node=0; node<count; ++node)
+            {
+                for (auto slot=offsets[node]; slot<offsets[node + 1]; ++slot)
+                {
+                    auto const row = neighbors(targets[slot]);
+                    reverse[slot] = static_cast<size_t>(std::lower_bound(row.begin(), row.end(), node) - row.begin());
+                }
+            }
+            if (count && eccentricity(0) == unreachable)
+            {
+                throw std::runtime_error("The graph of " + std::to_string(count) + " nodes is not connected");
+            }
+        }
+
+        auto size() const { return offsets.size() - 1; }
+        auto getEdgeCount() const { return targets.size() / 2; }
+        Neighbors neighbors(size_t node) const { return { targets.data() + offsets[node], targets.data() + offsets[node + 1] }; }
+        // the port of the node on the other end of a port, under which that node knows this one
+        auto remotePort(size_t node, size_t port) const { return reverse[offsets[node] + port]; }
+
+        // the most hops from the node to any other, by breadth first search: the diameter is between it and twice it
+        size_t eccentricity(size_t from) const
+        {
+            vector<size_t> distances(size(), unreachable);
+            queue<size_t> next;
+            distances[from] = 0;
+            next.push(from);
+            size_t ret = 0;
+            size_t reached = 0;
+            while (next.empty() == false)
+            {
+                auto const node = next.front();
+                next.pop();
+                ++reached;
+                ret = std::max(ret, distances[node]);
+                for (auto neighbor: neighbors(node))
+                {
+                    if (distances[neighbor] == unreachable)
+                    {
+                        distances[neighbor] = distances[node] + 1;
+                        next.push(neighbor);
+                    }
+                }
+            }
+            return reached == size() ? ret : unreachable;
+        }
+
+    private:
+        static size_t constexpr unreachable = ~size_t{0};
+        vector<size_t> offsets;
+        vector<size_t> targets;
+        vector<size_t> reverse;
+    };
+
+    Graph ring(size_t count)
+    {
+        vector<Edge> edges;
+        for (size_t i=0; count > 1 && i<count; ++i)
+        {
+            edges.emplace_back(i, (i + 1) % count);
+        }
+        return Graph{count, std::move(edges)};
+    }
+
+    // by default as square as the count allows: the rows are its largest divisor up to its square root
+    Graph torus(size_t count, size_t rows)
+    {
+        if (rows == 0)
+        {
+            for (rows = 1; (rows + 1) * (rows + 1) <= count; ++rows)
+            {
+            }
+            while (count % rows)
+            {
+                --rows;
+            }
+        }
+        if (count % rows)
+        {
+            throw std::runtime_error(std::to_string(rows) + " rows do not divide " + std::to_string(count) + " nodes");
+        }
+        auto const columns = count / rows;
+        vector<Edge> edges;
+        for (size_t row=0; row<rows; ++row)
+        {
+            for (size_t column=0; column<columns; ++column)
+            {
+                auto const node = row * columns + column;
+                if (columns > 1)
+                {
+                    edges.emplace_back(node, row * columns + (column + 1) % columns);
+                }
+                if (rows > 1)
+                {
+                    edges.emplace_back(node, ((row + 1) % rows) * columns + column);
+                }
+            }
+        }
+        return Graph{count, std::move(edges)};
+    }
+
+    Graph tree(size_t count, size_t arity)
+    {
+        if (arity == 0)
+        {
+            throw std::runtime_error("A tree needs an arity of at least 1");
+        }
+        vector<Edge> edges;
+        for (size_t i=1; i<count; ++i)
+        {
+            edges.emplace_back((i - 1) / arity, i);
+        }
+        return Graph{count, std::move(edges)};
+    }
+
+    // the union of degree/2 Hamiltonian cycles through the nodes in random orders: connected by construction,
+    // and of the given degree but for the rare edges that two cycles share, which are merged
+    Graph randomRegular(size_t count, size_t degree, uint64_t seed)
+    {
+        if (degree < 2 || degree % 2)
+        {
+            throw std::runtime_error("A random regular graph needs an even degree of at least 2, not " + std::to_string(degree));
+        }
+        vector<Edge> edges;
+        vector<size_t> order(count);
+        for (size_t cycle=0; cycle<degree/2; ++cycle)
+        {
+            std::iota(order.begin(), order.end(), 0);
+            // Fisher-Yates, with the mixer of the ID permutation as the random source
+            for (size_t i=count; i>1; --i)
+            {
+                seed = permutation::mix(seed);
+                std::swap(order[i - 1], order[seed % i]);
+            }
+            for (size_t i=0; count > 1 && i<count; ++i)
+            {
+                edges.emplace_back(order[i], order[(i + 1) % count]);
+            }
+        }
+        return Graph{count, std::move(edges)};
+    }
+
+    // the edges are those of the input for Kind::Edges
+    Graph build(Spec const& spec, size_t count, vector<Edge> edges, uint64_t seed)
+    {
+        switch (spec.kind)
+        {
+        case Kind::Ring: return ring(count);
+        case Kind::Torus: return torus(count, spec.parameter);
+        case Kind::Tree: return tree(count, spec.parameter ? spec.parameter : 2);
+        case Kind::Regular: return randomRegular(count, spec.parameter ? spec.parameter : 4, seed);
+        case Kind::Edges: return Graph{count, std::move(edges)};
+        }
+        throw std::runtime_error("Unknown topology");
+    }
+}
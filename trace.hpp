@@ -0,0 +1,389 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "json.hpp"
+#include "election.hpp"
+#include "input.hpp"
+
+using namespace std;
+using namespace json;
+
+// Binary trace of what the nodes do: every send, receive and state change, with a monotonic timestamp and the node index.
+// Each thread reserves a chunk of a memory-mapped file and writes its events straight into it,
+// so recording is a clock read and a 32-byte store, without a lock nor a writer thread.
+// The chunks are appended in the order they are reserved: the events are only sorted by time when the trace is read.
+namespace trace
+{
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the events are written as they are in memory");
+
+    // file layout, integers are little endian:
+    //   magic      4 bytes, "TRCE"
+    //   version    1 byte
+    //   algorithm  1 byte
+    //   discovery  1 byte
+    //   reserved   1 byte, zero
+    //   count      8 bytes, of nodes
+    //   dropped    8 bytes, events lost when the file was full
+    //   ids        count 8-byte IDs, in ring order
+    //   events     32 bytes each, the zeroed ones are the unused end of a chunk
+    char constexpr magic[4] = { 'T', 'R', 'C', 'E' };
+    uint8_t constexpr version = 1;
+    size_t constexpr headerSize = 24;
+
+    enum struct Kind : uint8_t
+    {
+        None,       // never written
+        Begin,      // Node::begin, phase is 1 for the initiator
+        BeginReady, // Node::beginReady
+        Send,       // a message handed to the link on the given side
+        Receive,    // a message from the neighbor on the given side
+        State,      // the machine entered the state in type
+    };
+
+    struct Event
+    {
+        uint64_t time; // steady clock nanoseconds, the same clock in every process of the host
+        uint32_t node;
+        Kind kind;
+        uint8_t side;
+        uint8_t type;
+        uint8_t phase;
+        uint64_t id;
+        uint32_t hops;
+        uint32_t epoch;
+
+        auto toMessage() const { return Message{ id, static_cast<Message::Type>(type), "", phase, hops, epoch }; }
+        auto getSide() const { return side ? election::Side::CounterClockwise : election::Side::Clockwise; }
+    };
+    static_assert(sizeof(Event) == 32);
+
+    auto now()
+    {
+        return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    auto messageEvent(Kind kind, uint32_t node, Message const& msg, election::Side side)
+    {
+        return Event{ now(), node, kind, static_cast<uint8_t>(side == election::Side::Clockwise ? 0 : 1),
+            static_cast<uint8_t>(msg.type), msg.phase, msg.id, msg.hops, msg.epoch };
+    }
+
+    auto beginEvent(uint32_t node, Kind kind, bool initiator = false)
+    {
+        return Event{ now(), node, kind, 0, 0, static_cast<uint8_t>(initiator), 0, 0, 0 };
+    }
+
+    auto stateEvent(uint32_t node, election::State state)
+    {
+        return Event{ now(), node, Kind::State, 0, static_cast<uint8_t>(state), 0, 0, 0, 0 };
+    }
+
+    class Tracer
+    {
+    public:
+        static Tracer& instance()
+        {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        bool enabled() const { return on.load(memory_order_relaxed); }
+
+        // the file is sized to the capacity up front, sparse until written, and cut down to what was used by stop()
+        void start(filesystem::path const& path, election::Algorithm algorithm, election::Discovery discovery,
+            vector<election::ID> const& ids, size_t capacity = size_t{1} << 30)
+        {
+            stop();
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Failed to open the trace " + path.string() + ": " + strerror(errno));
+            }
+            eventsOffset = headerSize + ids.size() * sizeof(uint64_t);
+            size = eventsOffset + capacity / sizeof(Event) * sizeof(Event);
+            void* mapping = MAP_FAILED;
+            if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+            {
+                mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            if (mapping == MAP_FAILED)
+            {
+                auto const error = errno;
+                ::close(fd);
+                fd = -1;
+                throw std::runtime_error("Failed to map the trace " + path.string() + ": " + strerror(error));
+            }
+            base = static_cast<char*>(mapping);
+            memcpy(base, magic, sizeof magic);
+            base[4] = static_cast<char>(version);
+            base[5] = static_cast<char>(algorithm);
+            base[6] = static_cast<char>(discovery);
+            uint64_t const count = ids.size();
+            memcpy(base + 8, &count, sizeof count);
+            memcpy(base + headerSize, ids.data(), ids.size() * sizeof(uint64_t));
+            capacityEvents = (size - eventsOffset) / sizeof(Event);
+            reserved = 0;
+            dropped = 0;
+            generation.fetch_add(1, memory_order_relaxed);
+            events.store(reinterpret_cast<Event*>(base + eventsOffset), memory_order_release);
+            on = true;
+        }
+
+        // records in memory instead of in a file, for a replay on a single thread, until called with nothing
+        void capture(vector<Event>* into)
+        {
+            captured = into;
+            on = into != nullptr || base != nullptr;
+        }
+
+        // once the traced threads are done, returns the number of events dropped because the file was full
+        uint64_t stop()
+        {
+            if (base == nullptr)
+            {
+                return 0;
+            }
+            on = captured != nullptr;
+            events.store(nullptr, memory_order_relaxed);
+            uint64_t const lost = dropped.load(memory_order_relaxed);
+            memcpy(base + 16, &lost, sizeof lost);
+            auto const used = eventsOffset + std::min(reserved.load(memory_order_relaxed), capacityEvents) * sizeof(Event);
+            munmap(base, size);
+            base = nullptr;
+            // a file that cannot be cut keeps its sparse capacity, whose zeroed events are skipped when read
+            auto const truncated = ::ftruncate(fd, static_cast<off_t>(used));
+            (void) truncated;
+            ::close(fd);
+            fd = -1;
+            return lost;
+        }
+
+        void record(Event const& event)
+        {
+            if (captured)
+            {
+                captured->push_back(event);
+                return;
+            }
+            auto& chunk = local();
+            if (chunk.next == chunk.end || chunk.generation != generation.load(memory_order_relaxed))
+            {
+                if (reserve(chunk) == false)
+                {
+                    dropped.fetch_add(1, memory_order_relaxed);
+                    return;
+                }
+            }
+            *chunk.next++ = event;
+        }
+
+        ~Tracer() { stop(); }
+
+    private:
+        // a page of events, so that a thread that records little costs little
+        static size_t constexpr chunkEvents = 128;
+
+        struct Chunk
+        {
+            uint64_t generation = 0;
+            Event* next = nullptr;
+            Event* end = nullptr;
+        };
+
+        atomic<bool> on{false};         // nothing is traced until start() or capture()
+        atomic<Event*> events{nullptr};
+        vector<Event>* captured = nullptr;
+        atomic<uint64_t> generation{0}; // of the file, the chunks of a previous one are abandoned
+        atomic<size_t> reserved{0};     // events, including the unused end of the chunks
+        atomic<uint64_t> dropped{0};
+        size_t capacityEvents = 0;
+        size_t eventsOffset = 0;
+        size_t size = 0;
+        char* base = nullptr;
+        int fd = -1;
+
+        static Chunk& local()
+        {
+            thread_local Chunk chunk;
+            return chunk;
+        }
+
+        bool reserve(Chunk& chunk)
+        {
+            chunk.generation = generation.load(memory_order_relaxed);
+            chunk.next = chunk.end = nullptr;
+            auto const first = reserved.fetch_add(chunkEvents, memory_order_relaxed);
+            auto const events = this->events.load(memory_order_acquire);
+            if (events == nullptr || first + chunkEvents > capacityEvents)
+            {
+                return false;
+            }
+            chunk.next = events + first;
+            chunk.end = chunk.next + chunkEvents;
+            return true;
+        }
+    };
+
+    auto enabled() { return Tracer::instance().enabled(); }
+    void record(Event const& event) { Tracer::instance().record(event); }
+    void start(filesystem::path const& path, election::Algorithm algorithm, election::Discovery discovery, vector<election::ID> const& ids)
+    {
+        Tracer::instance().start(path, algorithm, discovery, ids);
+    }
+    auto stop() { return Tracer::instance().stop(); }
+    void capture(vector<Event>* into) { Tracer::instance().capture(into); }
+
+    // the same event, whenever it happened
+    auto same(Event const& a, Event const& b)
+    {
+        return std::tie(a.node, a.kind, a.side, a.type, a.phase, a.id, a.hops, a.epoch) ==
+            std::tie(b.node, b.kind, b.side, b.type, b.phase, b.id, b.hops, b.epoch);
+    }
+
+    struct Trace
+    {
+        election::Algorithm algorithm;
+        election::Discovery discovery;
+        vector<election::ID> ids;
+        uint64_t dropped = 0;
+        vector<Event> events; // by time, in the order they were recorded when at the same time
+    };
+
+    Trace read(filesystem::path const& path)
+    {
+        auto fail = [&path] (string const& message)
+        {
+            throw std::runtime_error("Error '" + message + "' for trace '" + path.string() + "'");
+        };
+        optional<input::MappedFile> mapped;
+        try
+        {
+            mapped.emplace(path);
+        }
+        catch (std::exception const& e)
+        {
+            fail(e.what());
+        }
+        auto const file = mapped->view();
+        if (file.size() < headerSize || memcmp(file.data(), magic, sizeof magic) != 0)
+        {
+            fail("Not a trace");
+        }
+        if (static_cast<uint8_t>(file[4]) != version)
+        {
+            fail("Unsupported trace version " + std::to_string(static_cast<uint8_t>(file[4])));
+        }
+        Trace ret;
+        ret.algorithm = static_cast<election::Algorithm>(file[5]);
+        ret.discovery = static_cast<election::Discovery>(file[6]);
+        auto const count = input::little<uint64_t>(file.data() + 8);
+        ret.dropped = input::little<uint64_t>(file.data() + 16);
+        if (count > (file.size() - headerSize) / sizeof(uint64_t))
+        {
+            fail("Truncated node IDs");
+        }
+        auto const eventsOffset = headerSize + count * sizeof(uint64_t);
+        if ((file.size() - eventsOffset) % sizeof(Event))
+        {
+            fail("Truncated events");
+        }
+        ret.ids.resize(count);
+        memcpy(ret.ids.data(), file.data() + headerSize, count * sizeof(uint64_t));
+        for (auto event = file.data() + eventsOffset; event < file.data() + file.size(); event += sizeof(Event))
+        {
+            Event decoded;
+            memcpy(&decoded, event, sizeof decoded);
+            if (decoded.kind == Kind::None)
+            {
+                continue;
+            }
+            if (decoded.kind > Kind::State || decoded.node >= count)
+            {
+                fail("Bad event at offset " + std::to_string(event - file.data()));
+            }
+            ret.events.push_back(decoded);
+        }
+        std::stable_sort(ret.events.begin(), ret.events.end(), [] (Event const& a, Event const& b) { return a.time < b.time; });
+        return ret;
+    }
+
+    // the Chrome trace-event format, for chrome://tracing or Perfetto: a row per node,
+    // the states as spans and the messages as instants, in microseconds from the first event
+    void writeChrome(Trace const& trace, filesystem::path const& path)
+    {
+        ofstream out{path, ios_base::out | ios_base::trunc};
+        if (out.good() == false)
+        {
+            throw std::runtime_error("Failed to open the Chrome trace " + path.string());
+        }
+        auto const origin = trace.events.empty() ? 0 : trace.events.front().time;
+        auto const last = trace.events.empty() ? 0 : trace.events.back().time;
+        auto microseconds = [origin] (uint64_t time) { return static_cast<double>(time - origin) / 1000; };
+        // the state each node is in, and since when
+        vector<optional<Event>> states(trace.ids.size());
+        auto first = true;
+        auto separator = [&out, &first] () -> ofstream&
+        {
+            out << (first ? "\n    " : ",\n    ");
+            first = false;
+            return out;
+        };
+        auto closeState = [&] (Event const& state, uint64_t until)
+        {
+            separator() << "{\"name\": \"" << election::describe(static_cast<election::State>(state.type)) <<
+                "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << state.node << ", \"ts\": " << microseconds(state.time) <<
+                ", \"dur\": " << microseconds(until) - microseconds(state.time) << "}";
+        };
+        out << "{\"traceEvents\": [";
+        for (size_t i=0; i<trace.ids.size(); ++i)
+        {
+            separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << i <<
+                ", \"args\": {\"name\": \"node " << i << " (" << trace.ids[i] << ")\"}}";
+        }
+        for (auto const& event: trace.events)
+        {
+            if (event.kind == Kind::State)
+            {
+                if (auto& state = states[event.node])
+                {
+                    closeState(*state, event.time);
+                }
+                states[event.node] = event;
+                continue;
+            }
+            auto const name = event.kind == Kind::Send ? "send " : event.kind == Kind::Receive ? "receive " : "begin";
+            separator() << "{\"name\": \"" << name <<
+                (event.kind == Kind::Send || event.kind == Kind::Receive ? json::describe(static_cast<Message::Type>(event.type)) : "") <<
+                "\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 0, \"tid\": " << event.node << ", \"ts\": " << microseconds(event.time) <<
+                ", \"args\": {\"id\": " << event.id << ", \"side\": \"" << (event.side ? "counter-clockwise" : "clockwise") <<
+                "\", \"phase\": " << unsigned{event.phase} << ", \"hops\": " << event.hops << ", \"epoch\": " << event.epoch << "}}";
+        }
+        for (auto const& state: states)
+        {
+            if (state)
+            {
+                closeState(*state, last);
+            }
+        }
+        out << "\n]}\n";
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write the Chrome trace " + path.string());
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "json.hpp"
+#include "logger.hpp"
+#include "spsc.hpp"
+
+using namespace std;
+using namespace json;
+
+// The links between neighbors, as seen by the talk and listen threads of a Node.
+// An endpoint is numbered like the node that talks on it, the next node listens to it.
+namespace transport
+{
+    enum struct Kind
+    {
+        Tcp,        // Qt sockets on the loopback, see qttransport.hpp
+        InProcess,  // shared memory queue between the two threads, no system call
+        Unix,       // AF_UNIX sockets named after the endpoint, see unixtransport.hpp
+        SocketPair, // anonymous AF_UNIX socket pairs, links within this process only
+    };
+
+    // reports errors that do not stop the link, such as a frame that failed to decode
+    using Report = function<void(logging::Level, string_view)>;
+
+    // the talk end of a link, only used by the thread releasing the messages of the timer wheel
+    class Sender
+    {
+    public:
+        virtual ~Sender() = default;
+        virtual void connect() = 0; // called once the listener is open, throws when it cannot be reached
+        // sends a batch of messages at once, in order
+        virtual void send(Message const* messages, size_t count) = 0;
+        void send(Message const& msg) { send(&msg, 1); }
+        virtual void disconnect() = 0;
+        virtual string describe() const = 0;
+        // what the link carried so far, only read by the thread that sends
+        auto getBytesSent() const { return bytesSent; }
+    protected:
+        uint64_t bytesSent = 0;
+    };
+
+    // the listen end of a link, only used by the listen thread
+    class Receiver
+    {
+    public:
+        virtual ~Receiver() = default;
+        virtual void open() = 0;   // throws when the endpoint cannot be bound
+        virtual void accept() = 0; // called once the sender is connected, throws when nobody connects before the timeout
+        // waits up to the timeout for messages and delivers all of those available
+        // returns false once the sender disconnected and everything it sent was delivered
+        virtual bool receive(chrono::milliseconds timeout, function<void(Message const&)> const& deliver) = 0;
+        virtual string describe() const = 0;
+    };
+
+    class InProcess
+    {
+    private:
+        struct Channel
+        {
+            shared_ptr<Doorbell> doorbell = make_shared<Doorbell>();
+            SpscQueue<Message, 256> queue{doorbell};
+            atomic<bool> closed{false}; // set by the sender after its last push
+        };
+
+        // the first of the two ends to ask for the channel creates it
+        static shared_ptr<Channel> channel(int endpoint)
+        {
+            static mutex lock;
+            static map<int, shared_ptr<Channel>> channels;
+            lock_guard<mutex> guard{lock};
+            auto& ret = channels[endpoint];
+            if (ret == nullptr)
+            {
+                ret = make_shared<Channel>();
+            }
+            return ret;
+        }
+
+    public:
+        class Sender : public transport::Sender
+        {
+        public:
+            explicit Sender(int endpoint) : endpoint(endpoint) {}
+            void connect() override { link = channel(endpoint); }
+            using transport::Sender::send;
+            void send(Message const* messages, size_t count) override
+            {
+                for (size_t i=0; i<count; ++i)
+                {
+                    link->queue.push(messages[i]);
+                }
+                bytesSent += count * sizeof(Message);
+            }
+            void disconnect() override
+            {
+                link->closed.store(true, memory_order_release);
+                link->doorbell->ring();
+            }
+            string describe() const override { return "in-process endpoint " + std::to_string(endpoint); }
+        private:
+            int const endpoint;
+            shared_ptr<Channel> link;
+        };
+
+        class Receiver : public transport::Receiver
+        {
+        public:
+            explicit Receiver(int endpoint) : endpoint(endpoint) {}
+            void open() override { link = channel(endpoint); }
+            void accept() override {}
+            bool receive(chrono::milliseconds timeout, function<void(Message const&)> const& deliver) override
+            {
+                link->doorbell->wait(timeout, [this] { return link->queue.size() > 0 || link->closed.load(memory_order_acquire); });
+                // read before popping: once closed, nothing is pushed any more
+                auto const closed = link->closed.load(memory_order_acquire);
+                while (auto msg = link->queue.pop())
+                {
+                    deliver(*msg);
+                }
+                return closed == false;
+            }
+            string describe() const override { return "in-process endpoint " + std::to_string(endpoint); }
+        private:
+            int const endpoint;
+            shared_ptr<Channel> link;
+        };
+    };
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "json.hpp"
+#include "transport.hpp"
+#include "wire.hpp"
+
+using namespace std;
+using namespace json;
+
+namespace transport
+{
+    // POSIX stream sockets carrying binary frames, without Qt on the path
+    class Native
+    {
+    private:
+        static auto constexpr timeout = 3000ms;
+
+        static auto error(string const& what)
+        {
+            return std::runtime_error(what + ": " + strerror(errno));
+        }
+
+        class StreamSender : public transport::Sender
+        {
+        public:
+            explicit StreamSender(Report report) : report(std::move(report)) {}
+            ~StreamSender() override { disconnect(); }
+            using transport::Sender::send;
+            // the whole batch goes out in a single write
+            void send(Message const* messages, size_t count) override
+            {
+                frames.resize(std::max(frames.size(), count * wire::maxFrameSize));
+                size_t size = 0;
+                for (size_t i=0; i<count; ++i)
+                {
+                    size += wire::encode(messages[i], frames.data() + size, frames.size() - size);
+                }
+                size_t written = 0;
+                while (written < size)
+                {
+                    auto ret = ::send(fd, frames.data() + written, size - written, MSG_NOSIGNAL);
+                    if (ret < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (ret <= 0)
+                    {
+                        report(logging::Level::Error, string{"Failed to send: "} + strerror(errno));
+                        return;
+                    }
+                    written += ret;
+                }
+                bytesSent += written;
+            }
+            void disconnect() override
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+        protected:
+            int fd = -1;
+            Report const report;
+        private:
+            vector<char> frames; // grows to the largest batch
+        };
+
+        class StreamReceiver : public transport::Receiver
+        {
+        public:
+            explicit StreamReceiver(Report report) : report(std::move(report)), buffer(wire::maxFrameSize) {}
+            ~StreamReceiver() override
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+            }
+            bool receive(chrono::milliseconds timeout, function<void(Message const&)> const& deliver) override
+            {
+                pollfd ready{ fd, POLLIN, 0 };
+                if (::poll(&ready, 1, static_cast<int>(timeout.count())) <= 0)
+                {
+                    return true;
+                }
+                auto read = ::recv(fd, buffer.data() + used, buffer.size() - used, MSG_DONTWAIT);
+                if (read == 0)
+                {
+                    // the sender is gone once the stream ends
+                    return false;
+                }
+                if (read < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                    {
+                        return true;
+                    }
+                    // a reset or broken stream keeps polling ready, and nothing more will come from it
+                    report(logging::Level::Error, string{"Failed to receive: "} + strerror(errno));
+                    return false;
+                }
+                used += read;
+
+                size_t offset = 0;
+                while (true)
+                {
+                    wire::FrameView frame;
+                    size_t consumed = 0;
+                    auto status = wire::decode(buffer.data() + offset, used - offset, frame, consumed);
+                    if (status == wire::Status::Incomplete)
+                    {
+                        break;
+                    }
+                    if (status != wire::Status::Ok)
+                    {
+                        // the stream cannot be resynchronized after a bad header
+                        report(logging::Level::Error, "Failed to decode frame, dropping " + std::to_string(used - offset) + " bytes");
+                        offset = used;
+                        break;
+                    }
+                    deliver(frame.toMessage());
+                    offset += consumed;
+                }
+                memmove(buffer.data(), buffer.data() + offset, used - offset);
+                used -= offset;
+                return true;
+            }
+        protected:
+            int fd = -1;
+            Report const report;
+        private:
+            // one frame always fits after the consumed ones are dropped, so a partial frame can always complete
+            vector<char> buffer;
+            size_t used = 0;
+        };
+
+        // a directory private to this process, so that endpoint names never collide with other runs
+        static filesystem::path const& directory()
+        {
+            struct Directory
+            {
+                filesystem::path path;
+                Directory()
+                {
+                    auto pattern = (filesystem::temp_directory_path() / "election-XXXXXX").string();
+                    if (::mkdtemp(pattern.data()) == nullptr)
+                    {
+                        throw error("Failed to create the socket directory");
+                    }
+                    path = pattern;
+                }
+                ~Directory()
+                {
+                    std::error_code ignored;
+                    filesystem::remove_all(path, ignored);
+                }
+            };
+            static Directory ret;
+            return ret.path;
+        }
+
+        static auto address(int endpoint)
+        {
+            auto path = (directory() / (std::to_string(endpoint) + ".sock")).string();
+            sockaddr_un ret{};
+            ret.sun_family = AF_UNIX;
+            if (path.size() >= sizeof ret.sun_path)
+            {
+                throw std::runtime_error("Socket path too long: " + path);
+            }
+            strncpy(ret.sun_path, path.c_str(), sizeof ret.sun_path - 1);
+            return ret;
+        }
+
+        // both ends of the socket pair of each endpoint, the first of the two ends to ask creates it
+        static int pairEnd(int endpoint, size_t end)
+        {
+            static mutex lock;
+            static map<int, array<int, 2>> pairs;
+            lock_guard<mutex> guard{lock};
+            auto found = pairs.find(endpoint);
+            if (found == pairs.end())
+            {
+                array<int, 2> fds;
+                if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds.data()) != 0)
+                {
+                    throw error("Failed to create a socket pair for endpoint " + std::to_string(endpoint));
+                }
+                found = pairs.emplace(endpoint, fds).first;
+            }
+            return found->second[end];
+        }
+
+    public:
+        // called before the processes of a ring fork, so that they all name their endpoints in the same directory
+        static void shareDirectory() { directory(); }
+
+        // AF_UNIX sockets named after the endpoint
+        class UnixSender : public StreamSender
+        {
+        public:
+            UnixSender(int endpoint, Report report) : StreamSender(std::move(report)), endpoint(endpoint) {}
+            void connect() override
+            {
+                auto const target = address(endpoint);
+                // the listener may not be bound yet
+                auto const deadline = chrono::steady_clock::now() + timeout;
+                while (true)
+                {
+                    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                    if (fd < 0)
+                    {
+                        throw error("Failed to create a socket");
+                    }
+                    if (::connect(fd, reinterpret_cast<sockaddr const*>(&target), sizeof target) == 0)
+                    {
+                        return;
+                    }
+                    disconnect();
+                    if (chrono::steady_clock::now() > deadline)
+                    {
+                        throw error("Failed to connect to endpoint " + std::to_string(endpoint));
+                    }
+                    std::this_thread::sleep_for(1ms);
+                }
+            }
+            string describe() const override { return "unix endpoint " + std::to_string(endpoint); }
+        private:
+            int const endpoint;
+        };
+
+        class UnixReceiver : public StreamReceiver
+        {
+        public:
+            UnixReceiver(int endpoint, Report report) : StreamReceiver(std::move(report)), endpoint(endpoint) {}
+            ~UnixReceiver() override
+            {
+                if (server >= 0)
+                {
+                    ::close(server);
+                    ::unlink(address(endpoint).sun_path);
+                }
+            }
+            void open() override
+            {
+                auto const local = address(endpoint);
+                server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if (server < 0
+                    || ::bind(server, reinterpret_cast<sockaddr const*>(&local), sizeof local) != 0
+                    || ::listen(server, 1) != 0)
+                {
+                    throw error("Failed to listen on endpoint " + std::to_string(endpoint));
+                }
+            }
+            void accept() override
+            {
+                pollfd ready{ server, POLLIN, 0 };
+                if (::poll(&ready, 1, static_cast<int>(timeout.count())) <= 0
+                    || (fd = ::accept(server, nullptr, nullptr)) < 0)
+                {
+                    throw std::runtime_error("nobody connected before timeout on endpoint " + std::to_string(endpoint));
+                }
+            }
+            string describe() const override { return "unix endpoint " + std::to_string(endpoint); }
+        private:
+            int const endpoint;
+            int server = -1;
+        };
+
+        // anonymous socket pairs, for links within this process: nothing to bind nor to wait for
+        class PairSender : public StreamSender
+        {
+        public:
+            PairSender(int endpoint, Report report) : StreamSender(std::move(report)), endpoint(endpoint) {}
+            void connect() override { fd = pairEnd(endpoint, 0); }
+            string describe() const override { return "socket pair " + std::to_string(endpoint); }
+        private:
+            int const endpoint;
+        };
+
+        class PairReceiver : public StreamReceiver
+        {
+        public:
+            PairReceiver(int endpoint, Report report) : StreamReceiver(std::move(report)), endpoint(endpoint) {}
+            void open() override { fd = pairEnd(endpoint, 1); }
+            void accept() override {}
+            string describe() const override { return "socket pair " + std::to_string(endpoint); }
+        private:
+            int const endpoint;
+        };
+    };
+}
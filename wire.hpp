@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "json.hpp"
+
+using namespace std;
+using namespace json;
+
+namespace wire
+{
+    enum struct Format
+    {
+        Binary, // fixed layout frames below
+        Text,   // json::to_string in a QString, for debugging
+    };
+
+    // frame layout, integers are little endian:
+    //   version    1 byte
+    //   type       1 byte
+    //   id         8 bytes, 2 bytes before version 3
+    //   phase      1 byte, since version 2
+    //   hops       4 bytes, since version 2
+    //   epoch      4 bytes, since version 4
+    //   value size 2 bytes
+    //   value      value size bytes
+    uint8_t constexpr version = 4;
+    size_t constexpr headerSize = 21;
+    size_t constexpr maxValueSize = Value::capacity;
+    size_t constexpr maxFrameSize = headerSize + maxValueSize;
+
+    // a decoded frame, the value points into the buffer it was decoded from
+    struct FrameView
+    {
+        decltype(Message::id) id;
+        Message::Type type;
+        string_view value;
+        decltype(Message::phase) phase;
+        decltype(Message::hops) hops;
+        decltype(Message::epoch) epoch;
+
+        auto toMessage() const { return Message{ id, type, value, phase, hops, epoch }; }
+    };
+
+    enum struct Status
+    {
+        Ok,
+        Incomplete, // the buffer ends before the frame does
+        BadVersion,
+        BadType,
+        ValueTooLarge,
+    };
+
+    size_t frameSize(Message const& msg)
+    {
+        return headerSize + msg.value.size();
+    }
+
+    // returns the frame size, or 0 when it does not fit in the buffer
+    // the value size is on 16 bits so that a later version can carry longer values in the same layout
+    size_t encode(Message const& msg, char* buffer, size_t capacity)
+    {
+        auto const size = frameSize(msg);
+        if (msg.value.size() > maxValueSize || size > capacity)
+        {
+            return 0;
+        }
+        auto out = reinterpret_cast<uint8_t*>(buffer);
+        auto const valueSize = static_cast<uint16_t>(msg.value.size());
+        out[0] = version;
+        out[1] = static_cast<uint8_t>(msg.type);
+        for (auto i=0; i<8; ++i)
+        {
+            out[2 + i] = static_cast<uint8_t>(msg.id >> (8 * i));
+        }
+        out[10] = msg.phase;
+        for (auto i=0; i<4; ++i)
+        {
+            out[11 + i] = static_cast<uint8_t>(msg.hops >> (8 * i));
+            out[15 + i] = static_cast<uint8_t>(msg.epoch >> (8 * i));
+        }
+        out[19] = static_cast<uint8_t>(valueSize);
+        out[20] = static_cast<uint8_t>(valueSize >> 8);
+        memcpy(buffer + headerSize, msg.value.data(), msg.value.size());
+        return size;
+    }
+
+    // decodes the frame at the front of the buffer, consumed is only set when the status is Ok
+    Status decode(char const* buffer, size_t size, FrameView& frame, size_t& consumed)
+    {
+        if (size < headerSize)
+        {
+            return Status::Incomplete;
+        }
+        auto in = reinterpret_cast<uint8_t const*>(buffer);
+        if (in[0] != version)
+        {
+            return Status::BadVersion;
+        }
+        if (in[1] > static_cast<uint8_t>(Message::lastType))
+        {
+            return Status::BadType;
+        }
+        auto const valueSize = static_cast<size_t>(in[19] | (in[20] << 8));
+        if (valueSize > maxValueSize)
+        {
+            return Status::ValueTooLarge;
+        }
+        if (size < headerSize + valueSize)
+        {
+            return Status::Incomplete;
+        }
+        frame.type = static_cast<Message::Type>(in[1]);
+        frame.id = 0;
+        for (auto i=0; i<8; ++i)
+        {
+            frame.id |= static_cast<decltype(frame.id)>(in[2 + i]) << (8 * i);
+        }
+        frame.phase = in[10];
+        frame.hops = 0;
+        frame.epoch = 0;
+        for (auto i=0; i<4; ++i)
+        {
+            frame.hops |= static_cast<decltype(frame.hops)>(in[11 + i]) << (8 * i);
+            frame.epoch |= static_cast<decltype(frame.epoch)>(in[15 + i]) << (8 * i);
+        }
+        frame.value = string_view{buffer + headerSize, valueSize};
+        consumed = headerSize + valueSize;
+        return Status::Ok;
+    }
+}